@@ -0,0 +1,123 @@
+#include "PreScreen.h"
+#include <fstream>
+
+PreScreen::PreScreen(uint32_t n_nodes, uint32_t n_cores, uint32_t n_rx_queues,
+                     uint32_t reta_size, double capacity_per_core)
+    : m_n_nodes(n_nodes), m_n_cores(n_cores), m_n_rx_queues(n_rx_queues),
+      m_reta_size(reta_size), m_capacity_per_core(capacity_per_core)
+{
+  if ((n_nodes == 0) || (n_cores == 0) || (n_rx_queues == 0) ||
+      (reta_size == 0) || (capacity_per_core <= 0.0)) {
+    throw cRuntimeError("invalid pre-screen parameters");
+  }
+
+  core_t core = {0, 0.0, 0.0};
+  m_cores.assign(m_n_nodes, std::vector<core_t>(m_n_cores, core));
+  m_t_duration = 0;
+}
+
+void PreScreen::add_trace(const TraceCache::trace_t *trace,
+                          const TraceCache::ipp_t *ipp)
+{
+  for (size_t i = 0; i < trace->size(); i++) {
+    const trace_pkt_t &pkt = (*trace)[i];
+
+    // the generator assumes 0 instructions once the ipp file is exhausted
+    uint32_t instr = (i < ipp->size()) ? (*ipp)[i] : 0;
+    double t_serv = instr / m_capacity_per_core;
+
+    core_t &core =
+        m_cores[pkt.crc32_hash % m_n_nodes][calc_core(pkt.toeplitz_hash)];
+    core.n_pkts++;
+    core.t_serv += t_serv;
+    core.t_serv_2 += t_serv * t_serv;
+
+    if (pkt.t > m_t_duration) {
+      m_t_duration = pkt.t;
+    }
+  }
+}
+
+uint32_t PreScreen::calc_core(uint32_t toeplitz_hash)
+{
+  // initial reta assignment and rx queue to core mapping of the node
+  uint32_t rx_queue = (toeplitz_hash % m_reta_size) % m_n_rx_queues;
+  return rx_queue % m_n_cores;
+}
+
+double PreScreen::get_util()
+{
+  double t_serv = 0.0;
+  for (uint32_t i = 0; i < m_n_nodes; i++) {
+    for (uint32_t j = 0; j < m_n_cores; j++) {
+      t_serv += m_cores[i][j].t_serv;
+    }
+  }
+  return t_serv / (m_n_nodes * m_n_cores * SIMTIME_DBL(m_t_duration));
+}
+
+double PreScreen::get_util_node_max()
+{
+  double util_max = 0.0;
+  for (uint32_t i = 0; i < m_n_nodes; i++) {
+    double t_serv = 0.0;
+    for (uint32_t j = 0; j < m_n_cores; j++) {
+      t_serv += m_cores[i][j].t_serv;
+    }
+    double util = t_serv / (m_n_cores * SIMTIME_DBL(m_t_duration));
+    if (util > util_max) {
+      util_max = util;
+    }
+  }
+  return util_max;
+}
+
+uint32_t PreScreen::find_core_max()
+{
+  uint32_t idx_max = 0;
+  for (uint32_t i = 1; i < m_n_nodes * m_n_cores; i++) {
+    if (m_cores[i / m_n_cores][i % m_n_cores].t_serv >
+        m_cores[idx_max / m_n_cores][idx_max % m_n_cores].t_serv) {
+      idx_max = i;
+    }
+  }
+  return idx_max;
+}
+
+double PreScreen::get_util_core_max()
+{
+  uint32_t idx = find_core_max();
+  return m_cores[idx / m_n_cores][idx % m_n_cores].t_serv /
+         SIMTIME_DBL(m_t_duration);
+}
+
+double PreScreen::get_t_wait_core_max()
+{
+  // pollaczek-khinchine mean waiting time of the most utilized core
+  uint32_t idx = find_core_max();
+  const core_t &core = m_cores[idx / m_n_cores][idx % m_n_cores];
+  if (core.n_pkts == 0) {
+    return 0.0;
+  }
+
+  double rate = core.n_pkts / SIMTIME_DBL(m_t_duration);
+  double util = core.t_serv / SIMTIME_DBL(m_t_duration);
+  if (util >= 1.0) {
+    return INFINITY;
+  }
+  return rate * (core.t_serv_2 / core.n_pkts) / (2.0 * (1.0 - util));
+}
+
+void PreScreen::write(const char *filename, bool in_range)
+{
+  std::ofstream file(filename);
+  if (file.is_open() == false) {
+    throw cRuntimeError("could not create pre-screen file");
+  }
+
+  file << "util " << get_util() << "\n";
+  file << "util_node_max " << get_util_node_max() << "\n";
+  file << "util_core_max " << get_util_core_max() << "\n";
+  file << "t_wait_core_max " << get_t_wait_core_max() << "\n";
+  file << "in_range " << in_range << "\n";
+}
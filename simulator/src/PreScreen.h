@@ -0,0 +1,48 @@
+#ifndef PRESCREEN_H_
+#define PRESCREEN_H_
+
+#include "modules/TraceCache.h"
+
+// analytical estimate of the load of a run, used by the sweep runner to skip
+// or flag runs whose outcome is obvious. packets are distributed to the nodes
+// by their crc32 hash (like the tor) and to the cores by their toeplitz hash
+// and the initial rss reta (like the offload module). the utilization of the
+// nodes is computed as fluid model, i.e. assuming that offloading balances
+// the load perfectly. the cores are modelled as independent m/g/1 queues
+// without any balancing
+class PreScreen
+{
+public:
+  PreScreen(uint32_t n_nodes, uint32_t n_cores, uint32_t n_rx_queues,
+            uint32_t reta_size, double capacity_per_core);
+
+  void add_trace(const TraceCache::trace_t *trace,
+                 const TraceCache::ipp_t *ipp);
+
+  double get_util();
+  double get_util_node_max();
+  double get_util_core_max();
+  double get_t_wait_core_max();
+  void write(const char *filename, bool in_range);
+
+private:
+  typedef struct {
+    uint64_t n_pkts; // packets
+    double t_serv;   // sum of service times
+    double t_serv_2; // sum of squared service times
+  } core_t;
+
+  uint32_t calc_core(uint32_t toeplitz_hash);
+  uint32_t find_core_max();
+
+  uint32_t m_n_nodes;
+  uint32_t m_n_cores;
+  uint32_t m_n_rx_queues;
+  uint32_t m_reta_size;
+  double m_capacity_per_core;
+
+  simtime_t m_t_duration;
+  std::vector<std::vector<core_t> > m_cores; // per node and core
+};
+
+#endif
@@ -0,0 +1,576 @@
+#include "SweepCmdenv.h"
+#include "PreScreen.h"
+#include "common/fileutil.h"
+#include "common/stringutil.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+Register_OmnetApp("Sweep", SweepCmdenv, 0,
+                  "forking command-line user interface for parameter sweeps");
+
+Register_GlobalConfigOption(CFGID_SWEEP_JOBS, "sweep-jobs", CFG_INT, "0",
+                            "Number of runs executed in parallel by the sweep "
+                            "runner. 0 means one per cpu core.");
+Register_PerRunConfigOption(CFGID_SWEEP_DONE_FILE, "sweep-done-file",
+                            CFG_FILENAME,
+                            "${resultdir}/${configname}-${runnumber}.done",
+                            "File created by the sweep runner once the run "
+                            "has completed. Runs whose file exists are "
+                            "skipped.");
+Register_PerRunConfigOption(CFGID_SWEEP_PRESCREEN, "sweep-prescreen",
+                            CFG_STRING, "off",
+                            "Analytical pre-screen of the runs: \"off\", "
+                            "\"flag\" (run, but mark runs out of range in "
+                            "the pre-screen file) or \"skip\" (do not "
+                            "execute runs out of range).");
+Register_PerRunConfigOption(CFGID_SWEEP_PRESCREEN_FILE,
+                            "sweep-prescreen-file", CFG_FILENAME,
+                            "${resultdir}/${configname}-${runnumber}.prescreen",
+                            "File the pre-screen estimates are written to.");
+Register_PerRunConfigOption(CFGID_SWEEP_PRESCREEN_UTIL_MIN,
+                            "sweep-prescreen-util-min", CFG_DOUBLE, "0.3",
+                            "Runs whose most utilized core is estimated "
+                            "below this utilization are out of range.");
+Register_PerRunConfigOption(CFGID_SWEEP_PRESCREEN_UTIL_MAX,
+                            "sweep-prescreen-util-max", CFG_DOUBLE, "1.0",
+                            "Runs whose nodes are estimated above this "
+                            "utilization on average are out of range.");
+Register_PerRunConfigOption(CFGID_SWEEP_PRESCREEN_N_NODES,
+                            "sweep-prescreen-n-nodes", CFG_INT, "4",
+                            "Number of nodes of the network.");
+Register_PerRunConfigOption(CFGID_SWEEP_CHECKPOINT_TIME,
+                            "sweep-checkpoint-time", CFG_DOUBLE, "0",
+                            "Simulation time at which runs that only differ "
+                            "in sweep-checkpoint-variables are forked off a "
+                            "shared warm-up. 0 disables checkpointing.");
+Register_PerRunConfigOption(CFGID_SWEEP_CHECKPOINT_VARIABLES,
+                            "sweep-checkpoint-variables", CFG_STRING, "",
+                            "Comma-separated iteration variables whose "
+                            "values only take effect after the checkpoint.");
+
+// parameters the modules support changing during the simulation (see their
+// handleParameterChange()). only these may differ between the runs sharing a
+// checkpoint
+static const char *s_runtime_params[] = {
+    "isrss_sim.modules.node.OffloadTrigger.threshold",
+    "isrss_sim.modules.node.Offload.hashtable_entry_timeout",
+    "isrss_sim.modules.node.Offload.adaptive_timeout_alpha",
+    "isrss_sim.modules.node.Offload.adaptive_timeout_factor",
+    "isrss_sim.modules.node.Offload.adaptive_timeout_min",
+    "isrss_sim.modules.node.ProcessingDynamicRSS.t_reassignment_interval",
+    "isrss_sim.modules.node.ProcessingDynamicRSS.balance_rx_queues",
+    "isrss_sim.modules.node.ProcessingDynamicRSS.enable_consolidation",
+    "isrss_sim.modules.node.ProcessingDynamicRSS.consolidation_target_util",
+    NULL};
+
+void SweepCmdenv::doRun()
+{
+  // get the configuration and the runs to execute
+  std::string config_name = opt()->configName;
+  if (config_name.empty()) {
+    config_name = "General";
+  }
+  std::vector<int> run_numbers;
+  try {
+    run_numbers =
+        resolveRunFilter(config_name.c_str(), opt()->runFilter.c_str());
+  } catch (std::exception &e) {
+    displayException(e);
+    exitCode = 1;
+    return;
+  }
+
+  // find the runs that have not been completed yet and load their traces.
+  // everything loaded here is inherited by the children. runs that share
+  // their warm-up are grouped, the first run of each group is the one
+  // simulating the warm-up
+  std::vector<std::vector<run_t> > groups;
+  std::map<std::string, size_t> group_keys;
+  for (size_t i = 0; i < run_numbers.size(); i++) {
+    getConfigEx()->activateConfig(config_name.c_str(), run_numbers[i]);
+    run_t run;
+    run.run_number = run_numbers[i];
+    run.filename_done = getConfig()->getAsFilename(CFGID_SWEEP_DONE_FILE);
+    run.t_checkpoint = getConfig()->getAsDouble(CFGID_SWEEP_CHECKPOINT_TIME);
+
+    struct stat st;
+    if (stat(run.filename_done.c_str(), &st) == 0) {
+      out << "Skipping run #" << run.run_number << ", already done"
+          << std::endl;
+      continue;
+    }
+
+    traces_t traces;
+    bool in_range;
+    std::string group_key;
+    try {
+      preload_traces(&traces);
+      in_range = prescreen(traces);
+      group_key = calc_group_key(run);
+    } catch (std::exception &e) {
+      displayException(e);
+      exitCode = 1;
+      return;
+    }
+    if (in_range == false) {
+      out << "Skipping run #" << run.run_number << ", out of range"
+          << std::endl;
+      continue;
+    }
+
+    std::map<std::string, size_t>::const_iterator it =
+        group_keys.find(group_key);
+    if (it == group_keys.end()) {
+      group_keys[group_key] = groups.size();
+      groups.push_back(std::vector<run_t>(1, run));
+    } else {
+      groups[it->second].push_back(run);
+    }
+  }
+
+  // number of runs executed in parallel
+  long n_jobs_max = getConfig()->getAsInt(CFGID_SWEEP_JOBS);
+  if (n_jobs_max <= 0) {
+    n_jobs_max = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  // execute runs, starting a new one whenever a previous one has finished.
+  // a group occupies one job per run, as all of them run in parallel once
+  // the warm-up is over
+  m_config_name = config_name;
+  m_n_jobs_failed = 0;
+  m_n_jobs_running = 0;
+  size_t n_runs = 0;
+  for (size_t i = 0; i < groups.size(); i++) {
+    while ((m_jobs.empty() == false) &&
+           (m_n_jobs_running + (long)groups[i].size() > n_jobs_max)) {
+      wait_job();
+    }
+    start_job(groups[i]);
+    n_runs += groups[i].size();
+  }
+  while (m_jobs.empty() == false) {
+    wait_job();
+  }
+
+  out << "Sweep finished: " << n_runs << " runs executed, "
+      << m_n_jobs_failed << " failed" << std::endl;
+  if (m_n_jobs_failed > 0) {
+    exitCode = 1;
+  }
+}
+
+void SweepCmdenv::preload_traces(traces_t *traces)
+{
+  // collect the filename parameters of each generator of the active run. keys
+  // look like "**.generators[0].filename_pcap", values are quoted strings
+  std::map<std::string, std::map<std::string, std::string> > filenames;
+  std::vector<const char *> entries = getConfigEx()->getKeyValuePairs();
+  for (size_t i = 0; i + 1 < entries.size(); i += 2) {
+    std::string key = entries[i];
+    std::string value = entries[i + 1];
+    size_t pos = key.rfind('.');
+    if ((pos == std::string::npos) ||
+        (key.compare(pos + 1, 9, "filename_") != 0)) {
+      continue;
+    }
+
+    // expressions other than string literals are left to the generator
+    if ((value.length() < 2) || (value[0] != '"') ||
+        (value[value.length() - 1] != '"')) {
+      continue;
+    }
+
+    filenames[key.substr(0, pos)][key.substr(pos + 1)] =
+        value.substr(1, value.length() - 2);
+  }
+
+  // load traces and ipp files into the trace cache. the ipp values are not
+  // known in advance if they are computed online
+  std::map<std::string, std::map<std::string, std::string> >::iterator it;
+  for (it = filenames.begin(); it != filenames.end(); it++) {
+    std::map<std::string, std::string> &f = it->second;
+    const TraceCache::trace_t *trace = NULL;
+    const TraceCache::ipp_t *ipp = NULL;
+    if (f.count("filename_pcap") && f.count("filename_pcap_ts") &&
+        f.count("filename_crc32") && f.count("filename_toeplitz") &&
+        f.count("filename_ids")) {
+      trace = TraceCache::get_trace(
+          f["filename_pcap"].c_str(), f["filename_pcap_ts"].c_str(),
+          f["filename_crc32"].c_str(), f["filename_toeplitz"].c_str(),
+          f["filename_ids"].c_str());
+    }
+    if (f.count("filename_ipp") && (f["filename_ipp"].empty() == false) &&
+        ((f.count("filename_actions") == 0) ||
+         f["filename_actions"].empty())) {
+      ipp = TraceCache::get_ipp(f["filename_ipp"].c_str());
+    }
+    if (trace) {
+      traces->push_back(std::make_pair(trace, ipp));
+    }
+  }
+}
+
+bool SweepCmdenv::prescreen(const traces_t &traces)
+{
+  std::string mode = getConfig()->getAsString(CFGID_SWEEP_PRESCREEN);
+  if (mode == "off") {
+    return true;
+  } else if ((mode != "flag") && (mode != "skip")) {
+    throw cRuntimeError("unknown pre-screen mode '%s'", mode.c_str());
+  }
+
+  // get the node parameters of the run. runs the model does not cover are
+  // always executed
+  const char *n_cores = find_config_value("n_cores");
+  const char *n_rx_queues = find_config_value("n_rx_queues");
+  const char *reta_size = find_config_value("hashtable_size");
+  const char *capacity_per_core = find_config_value("capacity_per_core");
+  if ((n_cores == NULL) || (reta_size == NULL) ||
+      (capacity_per_core == NULL) || traces.empty()) {
+    return true;
+  }
+  for (size_t i = 0; i < traces.size(); i++) {
+    if (traces[i].second == NULL) {
+      return true;
+    }
+  }
+
+  long n_nodes = getConfig()->getAsInt(CFGID_SWEEP_PRESCREEN_N_NODES);
+  long n_cores_val = atol(n_cores);
+  long n_rx_queues_val = n_rx_queues ? atol(n_rx_queues) : n_cores_val;
+  long reta_size_val = atol(reta_size);
+  double capacity_per_core_val = atof(capacity_per_core);
+  if ((n_nodes <= 0) || (n_cores_val <= 0) || (n_rx_queues_val <= 0) ||
+      (reta_size_val <= 0) || (capacity_per_core_val <= 0.0)) {
+    return true;
+  }
+
+  PreScreen model(n_nodes, n_cores_val, n_rx_queues_val, reta_size_val,
+                  capacity_per_core_val);
+  for (size_t i = 0; i < traces.size(); i++) {
+    model.add_trace(traces[i].first, traces[i].second);
+  }
+
+  // runs are out of range if the nodes are overloaded even if the load is
+  // balanced perfectly, or if no core becomes loaded enough for balancing to
+  // make a difference
+  bool in_range =
+      (model.get_util() <=
+       getConfig()->getAsDouble(CFGID_SWEEP_PRESCREEN_UTIL_MAX)) &&
+      (model.get_util_core_max() >=
+       getConfig()->getAsDouble(CFGID_SWEEP_PRESCREEN_UTIL_MIN));
+
+  // write estimates next to the results
+  std::string filename =
+      getConfig()->getAsFilename(CFGID_SWEEP_PRESCREEN_FILE);
+  std::string dirname = omnetpp::common::directoryOf(filename.c_str());
+  omnetpp::common::mkPath(dirname.c_str());
+  model.write(filename.c_str(), in_range);
+
+  return in_range || (mode == "flag");
+}
+
+const char *SweepCmdenv::find_config_value(const char *name)
+{
+  // value of the first entry of the active run assigning a parameter of the
+  // given name, e.g. "*.nodes[*].n_cores". entries are ordered by precedence
+  std::vector<const char *> entries = getConfigEx()->getKeyValuePairs();
+  size_t len = strlen(name);
+  for (size_t i = 0; i + 1 < entries.size(); i += 2) {
+    size_t key_len = strlen(entries[i]);
+    if ((key_len > len) && (entries[i][key_len - len - 1] == '.') &&
+        (strcmp(entries[i] + key_len - len, name) == 0)) {
+      return entries[i + 1];
+    }
+  }
+  return NULL;
+}
+
+std::string SweepCmdenv::calc_group_key(const run_t &run)
+{
+  // without checkpoint, each run forms its own group
+  if (run.t_checkpoint <= 0.0) {
+    return std::to_string(run.run_number);
+  }
+
+  // variants do not write vector files of their own (see checkpoint())
+  const char *vector_recording = find_config_value("vector-recording");
+  if ((vector_recording == NULL) || (strcmp(vector_recording, "false") != 0)) {
+    throw cRuntimeError("checkpointing requires **.vector-recording = false");
+  }
+
+  // runs are grouped by the values of all iteration variables, except for the
+  // ones only taking effect after the checkpoint
+  std::set<std::string> checkpoint_vars;
+  cStringTokenizer tokenizer(
+      getConfig()->getAsString(CFGID_SWEEP_CHECKPOINT_VARIABLES).c_str(), ",");
+  while (tokenizer.hasMoreTokens()) {
+    checkpoint_vars.insert(
+        omnetpp::common::opp_trim(tokenizer.nextToken()));
+  }
+
+  std::ostringstream key;
+  key << run.t_checkpoint;
+  std::vector<std::string> vars = getConfigEx()->getIterationVariableNames();
+  for (size_t i = 0; i < vars.size(); i++) {
+    if (checkpoint_vars.count(vars[i]) == 0) {
+      key << ";" << vars[i] << "="
+          << getConfigEx()->getVariable(vars[i].c_str());
+    }
+  }
+  return key.str();
+}
+
+void SweepCmdenv::start_job(const std::vector<run_t> &group)
+{
+  // flush buffered output, so that it is not written twice
+  out.flush();
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    throw cRuntimeError("could not fork sweep job");
+  }
+
+  if (pid == 0) {
+    // child: execute the group's first run like the regular command line
+    // interface would do. the other runs of the group are forked off at the
+    // checkpoint and continue from here as well. then wait for the forked
+    // runs and exit without returning into the sweep loop
+    m_jobs.clear();
+    m_n_jobs_failed = 0;
+    m_filename_done = group[0].filename_done;
+    m_t_checkpoint = group[0].t_checkpoint;
+    m_variants.assign(group.begin() + 1, group.end());
+    bool success;
+    try {
+      opt()->runFilter = std::to_string(group[0].run_number);
+      Cmdenv::doRun();
+      success = (exitCode == 0);
+
+      // if the run has ended before the checkpoint, e.g. because its trace is
+      // short or it has been stopped early, its variants have not been forked
+      // off. execute them from scratch instead
+      std::vector<run_t> variants;
+      variants.swap(m_variants);
+      m_warmup_scalars.clear();
+      for (size_t i = 0; i < variants.size(); i++) {
+        out << "Run #" << variants[i].run_number
+            << " did not reach the checkpoint, executing it from scratch"
+            << std::endl;
+        start_job(std::vector<run_t>(1, variants[i]));
+      }
+
+      while (m_jobs.empty() == false) {
+        wait_job();
+      }
+
+      // mark run as done only if it has completed successfully
+      if (success) {
+        write_done_file(m_filename_done);
+      }
+    } catch (std::exception &e) {
+      displayException(e);
+      success = false;
+    }
+    out.flush();
+    fflush(stdout);
+
+    // the exit status is the number of failed runs, including the ones of
+    // forked off variants
+    int n_runs_failed = m_n_jobs_failed + (success ? 0 : 1);
+    _exit(std::min(n_runs_failed, 255));
+  }
+
+  job_t job = {(long)group.size()};
+  m_jobs[pid] = job;
+  m_n_jobs_running += job.n_runs;
+}
+
+void SweepCmdenv::wait_job()
+{
+  int status;
+  pid_t pid = waitpid(-1, &status, 0);
+  if (pid < 0) {
+    throw cRuntimeError("could not wait for sweep job");
+  }
+
+  std::map<pid_t, job_t>::iterator it = m_jobs.find(pid);
+  if (it == m_jobs.end()) {
+    return;
+  }
+
+  // the job has marked its successful runs as done itself and exits with the
+  // number of failed runs. if it has been terminated, none of its runs is
+  // considered successful
+  if (WIFEXITED(status)) {
+    m_n_jobs_failed += WEXITSTATUS(status);
+  } else {
+    m_n_jobs_failed += it->second.n_runs;
+  }
+
+  m_n_jobs_running -= it->second.n_runs;
+  m_jobs.erase(it);
+}
+
+void SweepCmdenv::write_done_file(const std::string &filename)
+{
+  std::ofstream file(filename.c_str());
+  if (file.is_open() == false) {
+    throw cRuntimeError("could not create sweep done file");
+  }
+}
+
+void SweepCmdenv::simulationEvent(cEvent *event)
+{
+  Cmdenv::simulationEvent(event);
+
+  // fork off the variants before the first event after the checkpoint
+  if ((m_variants.empty() == false) &&
+      (SIMTIME_DBL(event->getArrivalTime()) >= m_t_checkpoint)) {
+    checkpoint();
+  }
+}
+
+void SweepCmdenv::recordScalar(cComponent *component, const char *name,
+                               double value, opp_string_map *attributes)
+{
+  Cmdenv::recordScalar(component, name, value, attributes);
+
+  // scalars recorded during the warm-up, e.g. in initialize(), are part of
+  // the variants' results as well. keep them to record them again once a
+  // variant has switched to its own run
+  if (m_variants.empty() == false) {
+    scalar_t scalar;
+    scalar.component = component;
+    scalar.name = name;
+    scalar.value = value;
+    scalar.has_attributes = (attributes != nullptr);
+    if (attributes) {
+      scalar.attributes = *attributes;
+    }
+    m_warmup_scalars.push_back(scalar);
+  }
+}
+
+void SweepCmdenv::checkpoint()
+{
+  // checkpoint is only taken once. the forked processes hold the complete
+  // simulation state, i.e. they continue exactly where the warm-up ended
+  std::vector<run_t> variants;
+  variants.swap(m_variants);
+  std::vector<scalar_t> scalars;
+  scalars.swap(m_warmup_scalars);
+
+  // parameter values of the warm-up run
+  cModule *module_network = getSimulation()->getSystemModule();
+  std::map<std::string, std::string> values;
+  collect_param_values(module_network, &values);
+
+  // flush results recorded so far, so that they are not written again by the
+  // variants
+  outScalarManager->flush();
+  outVectorManager->flush();
+  out.flush();
+  fflush(stdout);
+
+  for (size_t i = 0; i < variants.size(); i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      throw cRuntimeError("could not fork sweep variant");
+    }
+
+    if (pid == 0) {
+      // variant: switch to its run, i.e. record scalars to its own file, and
+      // apply the parameter values it differs in. modules apply the new
+      // values in handleParameterChange()
+      m_jobs.clear();
+      m_n_jobs_failed = 0;
+      m_filename_done = variants[i].filename_done;
+      getConfigEx()->activateConfig(m_config_name.c_str(),
+                                    variants[i].run_number);
+      outScalarManager->startRun();
+      for (size_t j = 0; j < scalars.size(); j++) {
+        outScalarManager->recordScalar(
+            scalars[j].component, scalars[j].name.c_str(), scalars[j].value,
+            scalars[j].has_attributes ? &scalars[j].attributes : nullptr);
+      }
+      out << "Run #" << variants[i].run_number << " continues from checkpoint"
+          << std::endl;
+      apply_param_values(module_network, values);
+      return;
+    }
+
+    job_t job = {1};
+    m_jobs[pid] = job;
+  }
+}
+
+void SweepCmdenv::collect_param_values(
+    cModule *module, std::map<std::string, std::string> *values)
+{
+  // values assigned to the module's parameters by the active configuration
+  for (int i = 0; i < module->getNumParams(); i++) {
+    cPar &par = module->par(i);
+    const char *value = getConfigEx()->getParameterValue(
+        module->getFullPath().c_str(), par.getName(), par.containsValue());
+    if (value) {
+      (*values)[module->getFullPath() + "." + par.getName()] = value;
+    }
+  }
+
+  for (cModule::SubmoduleIterator it(module); !it.end(); it++) {
+    collect_param_values(*it, values);
+  }
+}
+
+void SweepCmdenv::apply_param_values(
+    cModule *module, const std::map<std::string, std::string> &values)
+{
+  // assign all parameters whose value in the active configuration differs
+  // from the one of the warm-up run
+  for (int i = 0; i < module->getNumParams(); i++) {
+    cPar &par = module->par(i);
+    const char *value = getConfigEx()->getParameterValue(
+        module->getFullPath().c_str(), par.getName(), par.containsValue());
+    std::map<std::string, std::string>::const_iterator it =
+        values.find(module->getFullPath() + "." + par.getName());
+    if ((value == NULL) && (it == values.end())) {
+      continue;
+    } else if ((value != NULL) && (it != values.end()) &&
+               (it->second == value)) {
+      continue;
+    }
+
+    // parameters of other modules, or parameters that are not assigned by the
+    // configuration (e.g. computed by ned expressions), would silently keep
+    // the value of the warm-up run
+    if ((value == NULL) || (is_runtime_param(module, par.getName()) == false)) {
+      throw cRuntimeError("parameter '%s.%s' cannot be changed at the "
+                          "checkpoint, it must not depend on "
+                          "sweep-checkpoint-variables",
+                          module->getFullPath().c_str(), par.getName());
+    }
+    par.parse(value);
+  }
+
+  for (cModule::SubmoduleIterator it(module); !it.end(); it++) {
+    apply_param_values(*it, values);
+  }
+}
+
+bool SweepCmdenv::is_runtime_param(cModule *module, const char *name)
+{
+  std::string param = std::string(module->getNedTypeName()) + "." + name;
+  for (size_t i = 0; s_runtime_params[i] != NULL; i++) {
+    if (param == s_runtime_params[i]) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,92 @@
+#ifndef SWEEPCMDENV_H_
+#define SWEEPCMDENV_H_
+
+#include "cmdenv/cmdenv.h"
+#include "modules/TraceCache.h"
+#include <map>
+#include <set>
+#include <sys/types.h>
+
+using namespace omnetpp;
+using namespace omnetpp::cmdenv;
+
+// command line user interface for parameter sweeps (select with "-u Sweep").
+// instead of starting one process per run, it loads the traces and ipp files
+// of all selected runs into the trace cache once and then forks one child
+// process per run, which shares the decoded traces copy-on-write. at most
+// sweep-jobs children run at the same time. a run is skipped if its
+// sweep-done-file exists, which is only created after the run has completed
+// successfully, so that an interrupted sweep can simply be restarted.
+//
+// optionally, the load of each run is estimated analytically from its traces
+// (see PreScreen) before it is started. runs whose estimated load is outside
+// the configured range are flagged or skipped.
+//
+// runs that only differ in the sweep-checkpoint-variables share their
+// warm-up: the group's first run is simulated until sweep-checkpoint-time,
+// then the process is forked once per remaining run of the group. each fork
+// is a complete in-memory checkpoint of the simulation, which switches to its
+// own run, applies the parameter values it differs in and continues. only
+// parameters the modules support changing (handleParameterChange()) may
+// differ. scalars recorded during the warm-up are recorded again for each
+// variant. runs ending before the checkpoint execute their variants from
+// scratch
+class SweepCmdenv : public Cmdenv
+{
+protected:
+  virtual void doRun() override;
+  virtual void simulationEvent(cEvent *event) override;
+  virtual void recordScalar(cComponent *component, const char *name,
+                            double value,
+                            opp_string_map *attributes = nullptr) override;
+
+private:
+  typedef struct {
+    int run_number;
+    std::string filename_done;
+    double t_checkpoint;
+  } run_t;
+
+  typedef struct {
+    long n_runs; // runs executed by the job, including forked off variants
+  } job_t;
+
+  typedef struct {
+    cComponent *component;
+    std::string name;
+    double value;
+    bool has_attributes;
+    opp_string_map attributes;
+  } scalar_t;
+
+  typedef std::vector<std::pair<const TraceCache::trace_t *,
+                                const TraceCache::ipp_t *> >
+      traces_t;
+
+  void preload_traces(traces_t *traces);
+  bool prescreen(const traces_t &traces);
+  const char *find_config_value(const char *name);
+  std::string calc_group_key(const run_t &run);
+  void start_job(const std::vector<run_t> &group);
+  void wait_job();
+  void write_done_file(const std::string &filename);
+  void checkpoint();
+  void collect_param_values(cModule *module,
+                            std::map<std::string, std::string> *values);
+  void apply_param_values(cModule *module,
+                          const std::map<std::string, std::string> &values);
+  bool is_runtime_param(cModule *module, const char *name);
+
+  std::string m_config_name;
+  std::map<pid_t, job_t> m_jobs; // running children
+  std::string m_filename_done;   // done file of the run of this process
+  long m_n_jobs_running;
+  int m_n_jobs_failed;
+
+  // variants forked off at the checkpoint
+  double m_t_checkpoint;
+  std::vector<run_t> m_variants;
+  std::vector<scalar_t> m_warmup_scalars; // recorded before the checkpoint
+};
+
+#endif
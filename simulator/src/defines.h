@@ -4,5 +4,32 @@
 #define MSG_KIND_PACKET_DATA 0
 #define MSG_KIND_OFFLOAD_TRIGGER 1
 #define MSG_KIND_PROC_DONE 2
+#define MSG_KIND_DVFS_TICK 3
+#define MSG_KIND_FLOW_CONTROL 4
+#define MSG_KIND_RETA_UPDATE 5
+#define MSG_KIND_IN_FLIGHT_RELEASE 6
+#define MSG_KIND_QUEUE_LEN 7
+
+// scheduling priority of the zero-delay messages passed between the stages of
+// a node. they are delivered ahead of the other events at the same time, just
+// like the direct calls of the fast path (enable_fast_path), so that both
+// paths yield the same event order. messages leaving the node are reset to
+// the default priority
+#define MSG_PRIORITY_NODE_HANDOVER -1
+#define MSG_PRIORITY_DEFAULT 0
+
+// statistics level, selected at compile time (see makemake_sweep). detailed
+// statistics emit signals per packet and per state change, e.g. latencies,
+// queue lengths and utilizations. the aggregate level strips these emits from
+// the hot paths. event counters and the scalars recorded in finish() remain
+#define STATS_LEVEL_AGGREGATE 0
+#define STATS_LEVEL_DETAILED 1
+
+#ifndef STATS_LEVEL
+#define STATS_LEVEL STATS_LEVEL_DETAILED
+#endif
+
+// code guarded by this constant is removed by the compiler in aggregate builds
+constexpr bool STATS_DETAILED = (STATS_LEVEL >= STATS_LEVEL_DETAILED);
 
 #endif
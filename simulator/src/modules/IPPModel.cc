@@ -0,0 +1,289 @@
+#include "IPPModel.h"
+#include <fstream>
+#include <sstream>
+
+// max. number of attempts to find an action assignment within the error margin
+#define IPP_MODEL_MAX_ASSIGN_ATTEMPTS 1000
+
+// minimal json reader. supports everything the action configuration files
+// contain, but only keeps the values we are interested in
+static void json_skip_ws(const std::string &json, size_t &pos)
+{
+  while (pos < json.length() && isspace(json[pos])) {
+    pos++;
+  }
+}
+
+static void json_expect(const std::string &json, size_t &pos, char c)
+{
+  json_skip_ws(json, pos);
+  if (pos >= json.length() || json[pos] != c) {
+    throw cRuntimeError("could not parse actions file");
+  }
+  pos++;
+}
+
+static bool json_accept(const std::string &json, size_t &pos, char c)
+{
+  json_skip_ws(json, pos);
+  if (pos < json.length() && json[pos] == c) {
+    pos++;
+    return true;
+  }
+  return false;
+}
+
+static std::string json_parse_string(const std::string &json, size_t &pos)
+{
+  json_expect(json, pos, '"');
+  std::string str;
+  while (pos < json.length() && json[pos] != '"') {
+    if (json[pos] == '\\') {
+      // escaped character. keys and values we care about do not contain any,
+      // so just take the character following the backslash
+      pos++;
+    }
+    if (pos < json.length()) {
+      str += json[pos];
+      pos++;
+    }
+  }
+  json_expect(json, pos, '"');
+  return str;
+}
+
+static double json_parse_number(const std::string &json, size_t &pos)
+{
+  json_skip_ws(json, pos);
+  const char *start = json.c_str() + pos;
+  char *end;
+  double value = strtod(start, &end);
+  if (end == start) {
+    throw cRuntimeError("could not parse actions file");
+  }
+  pos += end - start;
+  return value;
+}
+
+static void json_skip_value(const std::string &json, size_t &pos)
+{
+  json_skip_ws(json, pos);
+  if (pos >= json.length()) {
+    throw cRuntimeError("could not parse actions file");
+  }
+
+  if (json[pos] == '{') {
+    pos++;
+    if (json_accept(json, pos, '}')) {
+      return;
+    }
+    do {
+      json_parse_string(json, pos);
+      json_expect(json, pos, ':');
+      json_skip_value(json, pos);
+    } while (json_accept(json, pos, ','));
+    json_expect(json, pos, '}');
+  } else if (json[pos] == '[') {
+    pos++;
+    if (json_accept(json, pos, ']')) {
+      return;
+    }
+    do {
+      json_skip_value(json, pos);
+    } while (json_accept(json, pos, ','));
+    json_expect(json, pos, ']');
+  } else if (json[pos] == '"') {
+    json_parse_string(json, pos);
+  } else if (isalpha(json[pos])) {
+    // true, false or null
+    while (pos < json.length() && isalpha(json[pos])) {
+      pos++;
+    }
+  } else {
+    json_parse_number(json, pos);
+  }
+}
+
+IPPModel::IPPModel(const char *filename_actions, cRNG *rng)
+{
+  m_rng = rng;
+  m_max_err = 0.0;
+  load_actions(filename_actions);
+}
+
+IPPModel::~IPPModel()
+{
+  m_actions.clear();
+  m_flow_bytes.clear();
+  m_flow_actions.clear();
+  m_action_bytes.clear();
+}
+
+void IPPModel::load_actions(const char *filename_actions)
+{
+  // read the whole file
+  std::ifstream file(filename_actions);
+  if (file.is_open() == false) {
+    throw cRuntimeError("could not open actions file");
+  }
+  std::stringstream buf;
+  buf << file.rdbuf();
+  std::string json = buf.str();
+
+  // iterate over the keys of the top-level object. only the actions and the
+  // max. assignment error are of interest here
+  size_t pos = 0;
+  json_expect(json, pos, '{');
+  do {
+    std::string key = json_parse_string(json, pos);
+    json_expect(json, pos, ':');
+
+    if (key == "actions") {
+      json_expect(json, pos, '[');
+      do {
+        action_t action;
+        action.ipp_base = 0;
+        action.ipp_payload = 0;
+        action.share = 0.0;
+
+        json_expect(json, pos, '{');
+        do {
+          std::string action_key = json_parse_string(json, pos);
+          json_expect(json, pos, ':');
+          if (action_key == "ipp_base") {
+            action.ipp_base = (uint32_t)json_parse_number(json, pos);
+          } else if (action_key == "ipp_payload") {
+            action.ipp_payload = (uint32_t)json_parse_number(json, pos);
+          } else if (action_key == "share") {
+            action.share = json_parse_number(json, pos);
+          } else {
+            json_skip_value(json, pos);
+          }
+        } while (json_accept(json, pos, ','));
+        json_expect(json, pos, '}');
+
+        m_actions.push_back(action);
+      } while (json_accept(json, pos, ','));
+      json_expect(json, pos, ']');
+    } else if (key == "max_err") {
+      m_max_err = json_parse_number(json, pos);
+    } else {
+      json_skip_value(json, pos);
+    }
+  } while (json_accept(json, pos, ','));
+  json_expect(json, pos, '}');
+
+  if (m_actions.empty()) {
+    throw cRuntimeError("actions file does not specify any actions");
+  }
+
+  // make sure that the assignment shares add up to one
+  double shares_total = 0.0;
+  for (size_t i = 0; i < m_actions.size(); i++) {
+    shares_total += m_actions[i].share;
+  }
+  if (fabs(1.0 - shares_total) > 0.000001) {
+    throw cRuntimeError("action shares do not add up to 1.0");
+  }
+}
+
+void IPPModel::add_flow_bytes(uint64_t flow_id, uint32_t n_bytes)
+{
+  // flow ids are assigned consecutively in the order flows appear in the trace
+  if (flow_id >= m_flow_bytes.size()) {
+    m_flow_bytes.resize(flow_id + 1, 0);
+  }
+  m_flow_bytes[flow_id] += n_bytes;
+}
+
+void IPPModel::assign_actions()
+{
+  // assign actions until the assigned shares are within the error margin
+  for (uint32_t i = 0; i < IPP_MODEL_MAX_ASSIGN_ATTEMPTS; i++) {
+    if (try_assign_actions()) {
+      return;
+    }
+  }
+  throw cRuntimeError("could not assign actions within error margin");
+}
+
+bool IPPModel::try_assign_actions()
+{
+  uint64_t n_flows = m_flow_bytes.size();
+  ASSERT(n_flows > 0);
+
+  // get the total number of bytes
+  uint64_t n_bytes_total = 0;
+  for (uint64_t i = 0; i < n_flows; i++) {
+    n_bytes_total += m_flow_bytes[i];
+  }
+
+  // randomly shuffle the order in which flows are assigned actions (c.f.
+  // fisher-yates shuffle)
+  std::vector<uint64_t> order(n_flows);
+  for (uint64_t i = 0; i < n_flows; i++) {
+    order[i] = i;
+  }
+  for (uint64_t i = n_flows - 1; i > 0; i--) {
+    uint64_t j = m_rng->intRand((uint32_t)(i + 1));
+    uint64_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  // assign each flow the action that needs most bytes to reach its target
+  // share. the first flow is always assigned the first action
+  m_flow_actions.assign(n_flows, 0);
+  m_action_bytes.assign(m_actions.size(), 0);
+  for (uint64_t i = 0; i < n_flows; i++) {
+    uint32_t action_id = 0;
+    double max_err = 0.0;
+    for (uint32_t j = 0; (i > 0) && (j < m_actions.size()); j++) {
+      double share = (double)m_action_bytes[j] / (double)n_bytes_total;
+      if (m_actions[j].share - share > max_err) {
+        max_err = m_actions[j].share - share;
+        action_id = j;
+      }
+    }
+
+    m_flow_actions[order[i]] = action_id;
+    m_action_bytes[action_id] += m_flow_bytes[order[i]];
+  }
+
+  // make sure assignment is within error margin
+  for (uint32_t i = 0; i < m_actions.size(); i++) {
+    if (fabs(get_action_share_assigned(i) - m_actions[i].share) > m_max_err) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t IPPModel::get_n_actions() { return m_actions.size(); }
+
+uint32_t IPPModel::get_action_id(uint64_t flow_id)
+{
+  ASSERT(flow_id < m_flow_actions.size());
+  return m_flow_actions[flow_id];
+}
+
+double IPPModel::get_action_share_assigned(uint32_t action_id)
+{
+  ASSERT(action_id < m_action_bytes.size());
+
+  uint64_t n_bytes_total = 0;
+  for (size_t i = 0; i < m_action_bytes.size(); i++) {
+    n_bytes_total += m_action_bytes[i];
+  }
+  return (double)m_action_bytes[action_id] / (double)n_bytes_total;
+}
+
+uint32_t IPPModel::calc_ipp(uint32_t action_id, uint32_t n_bytes_payload)
+{
+  ASSERT(action_id < m_actions.size());
+
+  // instructions to execute are composed of a fixed per-packet part and a
+  // part that depends on the packet's payload length
+  return m_actions[action_id].ipp_base +
+         n_bytes_payload * m_actions[action_id].ipp_payload;
+}
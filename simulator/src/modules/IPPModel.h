@@ -0,0 +1,47 @@
+#ifndef MODULES_IPPMODEL_H_
+#define MODULES_IPPMODEL_H_
+
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+// computes the number of instructions executed per packet (ipp) online. each
+// flow is assigned one of the actions (network functions) specified in the
+// same json configuration file used by the assign_network_functions tool.
+// actions are assigned such that the share of bytes processed by each action
+// matches the configured share
+class IPPModel
+{
+public:
+  IPPModel(const char *filename_actions, cRNG *rng);
+  virtual ~IPPModel();
+
+  void add_flow_bytes(uint64_t flow_id, uint32_t n_bytes);
+  void assign_actions();
+
+  uint32_t get_n_actions();
+  uint32_t get_action_id(uint64_t flow_id);
+  double get_action_share_assigned(uint32_t action_id);
+  uint32_t calc_ipp(uint32_t action_id, uint32_t n_bytes_payload);
+
+private:
+  typedef struct {
+    uint32_t ipp_base;    // instructions executed on every packet
+    uint32_t ipp_payload; // instructions executed per payload byte
+    double share;         // targeted share of bytes processed by the action
+  } action_t;
+
+  void load_actions(const char *filename_actions);
+  bool try_assign_actions();
+
+  cRNG *m_rng;
+
+  std::vector<action_t> m_actions;
+  double m_max_err;
+
+  std::vector<uint64_t> m_flow_bytes;
+  std::vector<uint32_t> m_flow_actions;
+  std::vector<uint64_t> m_action_bytes;
+};
+
+#endif
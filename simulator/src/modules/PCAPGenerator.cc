@@ -1,7 +1,8 @@
 #include "PCAPGenerator.h"
 #include "../defines.h"
 #include "../msgs/Packet.h"
-#include <netinet/ip.h>
+#include "IPPModel.h"
+#include "Profiler.h"
 
 Define_Module(PCAPGenerator);
 
@@ -9,6 +10,10 @@ PCAPGenerator::PCAPGenerator()
 {
   m_self_msg = new cMessage();
   m_self_msg->setContextPointer(NULL);
+  m_ipp_model = NULL;
+  m_reader = NULL;
+  m_trace = NULL;
+  m_ipp = NULL;
 }
 
 PCAPGenerator::~PCAPGenerator()
@@ -26,6 +31,9 @@ PCAPGenerator::~PCAPGenerator()
     delete it->second;
   }
   m_flows.clear();
+
+  delete m_ipp_model;
+  delete m_reader;
 }
 
 void PCAPGenerator::initialize()
@@ -37,53 +45,70 @@ void PCAPGenerator::initialize()
   const char *filename_crc32 = par("filename_crc32");
   const char *filename_toeplitz = par("filename_toeplitz");
   const char *filename_ids = par("filename_ids");
-
-  // open pcap file
-  char pcap_errbuf[PCAP_ERRBUF_SIZE];
-  m_pcap_descr = pcap_open_offline(filename_pcap, pcap_errbuf);
-  if (m_pcap_descr == NULL) {
-    throw cRuntimeError("could not open pcap file");
-  }
-
-  // open timestamp file
-  m_file_pcap_ts.open(filename_pcap_ts);
-  if (m_file_pcap_ts.is_open() == false) {
-    throw cRuntimeError("could not open pcap timestamp file");
-  }
-
-  // open file containing ipp values
-  m_file_ipp.open(filename_ipp);
-  if (m_file_ipp.is_open() == false) {
-    throw cRuntimeError("could not open ipp file");
+  const char *filename_actions = par("filename_actions");
+
+  // traces that are in the trace cache already (e.g. loaded by the sweep
+  // runner before forking) are always taken from it. otherwise the trace is
+  // only decoded into the cache if requested, and read packet by packet from
+  // the files if not
+  bool cache_trace = par("cache_trace");
+  if (cache_trace || TraceCache::find_trace(filename_pcap)) {
+    m_trace = TraceCache::get_trace(filename_pcap, filename_pcap_ts,
+                                    filename_crc32, filename_toeplitz,
+                                    filename_ids);
+    m_trace_idx = 0;
+  } else {
+    m_reader = new TraceReader(filename_pcap, filename_pcap_ts,
+                               filename_crc32, filename_toeplitz,
+                               filename_ids);
   }
 
-  // open file containing crc32 hashes
-  m_file_crc32.open(filename_crc32);
-  if (m_file_crc32.is_open() == false) {
-    throw cRuntimeError("could not open crc32 hash file");
+  // get ipp values the same way, unless they are computed online (see below)
+  if (strlen(filename_actions) == 0) {
+    if (cache_trace || TraceCache::find_ipp(filename_ipp)) {
+      m_ipp = TraceCache::get_ipp(filename_ipp);
+      m_ipp_idx = 0;
+    } else {
+      m_file_ipp.open(filename_ipp);
+      if (m_file_ipp.is_open() == false) {
+        throw cRuntimeError("could not open ipp file");
+      }
+    }
   }
 
-  // open file containing toeplitz hashes
-  m_file_toeplitz.open(filename_toeplitz);
-  if (m_file_toeplitz.is_open() == false) {
-    throw cRuntimeError("could not toeplitz hash file");
+  // compute ipp values online based on the actions assigned to the flows?
+  if (strlen(filename_actions) > 0) {
+    load_ipp_model(filename_actions);
   }
 
-  // open file containing flow and packet ids (if specified)
-  m_file_ids.open(filename_ids);
-  if (m_file_ids.is_open() == false) {
-    throw cRuntimeError("could not open id file");
+  // get traffic class assignment
+  std::string traffic_class_source =
+      par("traffic_class_source").stdstringValue();
+  m_traffic_class_dscp_min = par("traffic_class_dscp_min");
+  m_traffic_class_default = par("traffic_class_default");
+  if (traffic_class_source == "none") {
+    m_traffic_class_source = TC_NONE;
+  } else if (traffic_class_source == "map") {
+    m_traffic_class_source = TC_MAP;
+    load_traffic_classes(par("filename_traffic_classes"));
+  } else if (traffic_class_source == "dscp") {
+    m_traffic_class_source = TC_DSCP;
+  } else {
+    throw cRuntimeError("unknown traffic class source '%s'",
+                        traffic_class_source.c_str());
   }
 
   // get output transmission channel
   m_out_channel = gate("out")->getTransmissionChannel();
 
   // schedule first packet for transmission
-  schedule_pcap_packet(true);
+  schedule_pcap_packet();
 }
 
 void PCAPGenerator::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("PCAPGenerator");
+
   if (msg->isSelfMessage() == false) {
     throw cRuntimeError(
         "generator should never receive messages from other modules");
@@ -98,68 +123,23 @@ void PCAPGenerator::handleMessage(cMessage *msg)
   }
 
   // schedule next packet for transmission
-  schedule_pcap_packet(false);
+  schedule_pcap_packet();
 }
 
-void PCAPGenerator::schedule_pcap_packet(bool first)
+void PCAPGenerator::schedule_pcap_packet()
 {
-  pcap_pkthdr *pkt_hdr;
-  const uint8_t *pkt;
-
-  // get the next packet from pcap file
-  int32_t ret = pcap_next_ex(m_pcap_descr, &pkt_hdr, &pkt);
-  if (ret == 1) {
-    // all good
-  } else if (ret == -2) {
+  // get the next packet of the trace
+  trace_pkt_t pkt;
+  if (next_packet(&pkt) == false) {
     // no more packets
     return;
-  } else {
-    throw cRuntimeError("could not read from pcap file");
-  }
-
-  simtime_t t;
-
-  // get the next timestamp
-  std::string file_pcap_ts_line;
-  std::getline(m_file_pcap_ts, file_pcap_ts_line);
-
-  // find the decimal point
-  for (size_t i = 0; i < file_pcap_ts_line.length(); i++) {
-    if (file_pcap_ts_line[i] == '.') {
-      // found it!
-      if (first) {
-        m_pcap_offset_sec = atol(file_pcap_ts_line.substr(0, i).c_str());
-      } else {
-        t = atol(file_pcap_ts_line.substr(0, i).c_str()) - m_pcap_offset_sec;
-      }
-      t += atof((std::string("0.") + file_pcap_ts_line.substr(i + 1)).c_str());
-      break;
-    }
   }
 
-  // get next packet/flow id line from file
-  std::string ids_str;
-  std::getline(m_file_ids, ids_str);
-  const char *ids = ids_str.c_str();
-
-  // separate flow and packet ids (':' seperated)
-  char *p = strchr((char *)ids, ':');
-  ASSERT(p);
-  *p = 0;
-
-  // get flow and packet ids
-  uint64_t flow_id = atol(ids);
-  uint64_t pkt_id = atol(p + 1);
-
-  // get toeplitz hash value from file
-  std::string toeplitz_hash_str;
-  std::getline(m_file_toeplitz, toeplitz_hash_str);
-  uint32_t toeplitz_hash = atol(toeplitz_hash_str.c_str());
-
-  // get crc32 hash value from file
-  std::string crc32_hash_str;
-  std::getline(m_file_crc32, crc32_hash_str);
-  uint32_t crc32_hash = atol(crc32_hash_str.c_str());
+  simtime_t t = pkt.t;
+  uint64_t flow_id = pkt.flow_id;
+  uint64_t pkt_id = pkt.pkt_id;
+  uint32_t toeplitz_hash = pkt.toeplitz_hash;
+  uint32_t crc32_hash = pkt.crc32_hash;
 
   // get/create flow
   Flow *flow;
@@ -178,8 +158,9 @@ void PCAPGenerator::schedule_pcap_packet(bool first)
     ASSERT(flow->get_toeplitz_hash() == toeplitz_hash);
     ASSERT(flow->get_crc32_hash() == crc32_hash);
   } else {
-    // flow not found! create a new one
-    flow = new Flow(flow_id);
+    // flow not found! create a new one. flow ids are only unique per trace, so
+    // the flow is tagged with the generator's index
+    flow = new Flow(flow_id, getIndex());
 
     // must be the first packet of this flow
     ASSERT(pkt_id == 0);
@@ -188,28 +169,46 @@ void PCAPGenerator::schedule_pcap_packet(bool first)
     flow->set_toeplitz_hash(toeplitz_hash);
     flow->set_crc32_hash(crc32_hash);
 
+    // set the action that is executed on the flow's packets
+    if (m_ipp_model) {
+      flow->set_action_id(m_ipp_model->get_action_id(flow_id));
+    }
+
+    // set the flow's traffic class
+    flow->set_traffic_class(calc_traffic_class(flow_id, pkt));
+
     // save flow, reusing it later
     m_flows.insert(std::pair<uint64_t, Flow *>(flow_id, flow));
   }
 
-  // create new packet and set the flow
+  // create new packet and set the flow. the packet carries its own copy of the
+  // flow, so it does not reference the generator's state
   Packet *packet = new Packet();
-  packet->set_flow(flow);
+  packet->set_flow(*flow);
+  packet->set_traffic_class(flow->get_traffic_class());
 
   // generation time is when packet has been completely transmitted on the
   // link
   // TODO: currently multiplied by 2. move to sink
-  simtime_t t_generation = t + 2.0 * (8.0 * ((double)pkt_hdr->len) /
+  simtime_t t_generation = t + 2.0 * (8.0 * ((double)pkt.len) /
                                       m_out_channel->getNominalDatarate());
 
-  packet->setByteLength(pkt_hdr->len);
+  packet->setByteLength(pkt.len);
   packet->get_latency()->set_t_generation(t_generation);
   packet->setKind(MSG_KIND_PACKET_DATA);
 
-  // get ipp value from file
-  std::string instr_str;
-  std::getline(m_file_ipp, instr_str);
-  uint32_t instr = atol(instr_str.c_str());
+  uint32_t instr;
+  if (m_ipp_model) {
+    // calculate ipp value based on the flow's action and the packet's payload
+    // length
+    if (pkt.ip == false) {
+      throw cRuntimeError("trace packet is non-ip");
+    }
+    instr = m_ipp_model->calc_ipp(flow->get_action_id(), pkt.payload_len);
+  } else {
+    // get ipp value from file
+    instr = next_ipp();
+  }
 
   // set number of instructions to be executed on this packet
   packet->set_instr(instr);
@@ -223,3 +222,104 @@ void PCAPGenerator::schedule_pcap_packet(bool first)
   // schedule packet transmission
   scheduleAt(t, m_self_msg);
 }
+
+bool PCAPGenerator::next_packet(trace_pkt_t *pkt)
+{
+  if (m_reader) {
+    return m_reader->next(pkt);
+  }
+
+  if (m_trace_idx >= m_trace->size()) {
+    return false;
+  }
+  *pkt = (*m_trace)[m_trace_idx++];
+  return true;
+}
+
+uint32_t PCAPGenerator::next_ipp()
+{
+  if (m_ipp == NULL) {
+    std::string instr_str;
+    std::getline(m_file_ipp, instr_str);
+    return atol(instr_str.c_str());
+  }
+
+  // like the file, return 0 if the ipp values are exhausted
+  if (m_ipp_idx >= m_ipp->size()) {
+    return 0;
+  }
+  return (*m_ipp)[m_ipp_idx++];
+}
+
+void PCAPGenerator::rewind()
+{
+  if (m_reader) {
+    m_reader->rewind();
+  } else {
+    m_trace_idx = 0;
+  }
+}
+
+void PCAPGenerator::load_ipp_model(const char *filename_actions)
+{
+  // load actions. assignment is randomized using the module's rng, so that
+  // assignments differ with the seed of the run
+  m_ipp_model = new IPPModel(filename_actions, getRNG(0));
+
+  // actions are assigned based on the number of bytes per flow, so we have to
+  // go through the whole trace once before the simulation starts
+  trace_pkt_t pkt;
+  while (next_packet(&pkt)) {
+    m_ipp_model->add_flow_bytes(pkt.flow_id, pkt.len);
+  }
+
+  // assign actions to flows
+  m_ipp_model->assign_actions();
+
+  // record assigned shares
+  for (uint32_t i = 0; i < m_ipp_model->get_n_actions(); i++) {
+    char scalar[64];
+    sprintf(scalar, "ipp_model_share_action%d", i);
+    recordScalar(scalar, m_ipp_model->get_action_share_assigned(i));
+  }
+
+  // rewind trace
+  rewind();
+}
+
+void PCAPGenerator::load_traffic_classes(const char *filename_traffic_classes)
+{
+  std::ifstream file(filename_traffic_classes);
+  if (file.is_open() == false) {
+    throw cRuntimeError("could not open traffic class file");
+  }
+
+  // each line holds a flow id and the flow's traffic class
+  uint64_t flow_id;
+  uint32_t traffic_class;
+  while (file >> flow_id >> traffic_class) {
+    m_traffic_classes[flow_id] = traffic_class;
+  }
+}
+
+uint8_t PCAPGenerator::calc_traffic_class(uint64_t flow_id,
+                                          const trace_pkt_t &pkt)
+{
+  if (m_traffic_class_source == TC_NONE) {
+    return 0;
+  } else if (m_traffic_class_source == TC_MAP) {
+    std::map<uint64_t, uint8_t>::const_iterator it =
+        m_traffic_classes.find(flow_id);
+    if (it != m_traffic_classes.end()) {
+      return it->second;
+    }
+    return m_traffic_class_default;
+  }
+
+  // dscp taken from the ipv4 tos or the ipv6 traffic class field
+  if (pkt.ip == false) {
+    throw cRuntimeError("trace packet is non-ip");
+  }
+
+  return (pkt.dscp >= m_traffic_class_dscp_min) ? 0 : m_traffic_class_default;
+}
@@ -2,12 +2,14 @@
 #define MODULES_PCAPGENERATOR_H_
 
 #include "../msgs/Flow.h"
+#include "TraceCache.h"
 #include <fstream>
 #include <omnetpp.h>
-#include <pcap.h>
 
 using namespace omnetpp;
 
+class IPPModel;
+
 class PCAPGenerator : public cSimpleModule
 {
 public:
@@ -18,22 +20,37 @@ protected:
   virtual void initialize();
   virtual void handleMessage(cMessage *msg);
 
-  void schedule_pcap_packet(bool first);
+  void schedule_pcap_packet();
+  bool next_packet(trace_pkt_t *pkt);
+  uint32_t next_ipp();
+  void rewind();
+  void load_ipp_model(const char *filename_actions);
+  void load_traffic_classes(const char *filename_traffic_classes);
+  uint8_t calc_traffic_class(uint64_t flow_id, const trace_pkt_t &pkt);
 
 private:
   cMessage *m_self_msg;
   cChannel *m_out_channel;
 
-  pcap_t *m_pcap_descr;
-  __time_t m_pcap_offset_sec;
+  // trace is either read packet by packet or taken from the trace cache
+  TraceReader *m_reader;
+  const TraceCache::trace_t *m_trace;
+  size_t m_trace_idx;
 
-  std::ifstream m_file_pcap_ts;
+  // same for the ipp values
   std::ifstream m_file_ipp;
-  std::ifstream m_file_crc32;
-  std::ifstream m_file_toeplitz;
-  std::ifstream m_file_ids;
+  const TraceCache::ipp_t *m_ipp;
+  size_t m_ipp_idx;
 
   std::map<uint64_t, Flow *> m_flows;
+
+  IPPModel *m_ipp_model;
+
+  typedef enum { TC_NONE, TC_MAP, TC_DSCP } traffic_class_source_t;
+  traffic_class_source_t m_traffic_class_source;
+  std::map<uint64_t, uint8_t> m_traffic_classes;
+  uint8_t m_traffic_class_dscp_min;
+  uint8_t m_traffic_class_default;
 };
 
 #endif
@@ -0,0 +1,267 @@
+#include "PacketScheduler.h"
+#include "../defines.h"
+#include "../msgs/Packet.h"
+#include "Profiler.h"
+
+// orders packets by decreasing hop count. control messages go first
+static int compare_hop_cnt(cObject *a, cObject *b)
+{
+  cPacket *pkt_a = (cPacket *)a;
+  cPacket *pkt_b = (cPacket *)b;
+  int hop_cnt_a = (pkt_a->getKind() == MSG_KIND_PACKET_DATA)
+                      ? ((Packet *)pkt_a)->get_hop_cnt()
+                      : UINT8_MAX + 1;
+  int hop_cnt_b = (pkt_b->getKind() == MSG_KIND_PACKET_DATA)
+                      ? ((Packet *)pkt_b)->get_hop_cnt()
+                      : UINT8_MAX + 1;
+  return hop_cnt_b - hop_cnt_a;
+}
+
+// orders packets by increasing generation time. control messages go first
+static int compare_age(cObject *a, cObject *b)
+{
+  cPacket *pkt_a = (cPacket *)a;
+  cPacket *pkt_b = (cPacket *)b;
+  if (pkt_a->getKind() != MSG_KIND_PACKET_DATA) {
+    return (pkt_b->getKind() != MSG_KIND_PACKET_DATA) ? 0 : -1;
+  } else if (pkt_b->getKind() != MSG_KIND_PACKET_DATA) {
+    return 1;
+  }
+  simtime_t t_a = ((Packet *)pkt_a)->get_latency()->get_t_generation();
+  simtime_t t_b = ((Packet *)pkt_b)->get_latency()->get_t_generation();
+  return (t_a < t_b) ? -1 : ((t_a > t_b) ? 1 : 0);
+}
+
+PacketScheduler::PacketScheduler(const char *discipline, const char *order,
+                                 uint8_t n_classes, const char *weights,
+                                 uint32_t quantum, uint32_t capacity)
+{
+  // parse scheduling discipline
+  if (strcmp(discipline, "fifo") == 0) {
+    m_discipline = DISC_FIFO;
+  } else if (strcmp(discipline, "sp") == 0) {
+    m_discipline = DISC_SP;
+  } else if (strcmp(discipline, "drr") == 0) {
+    m_discipline = DISC_DRR;
+  } else if (strcmp(discipline, "wfq") == 0) {
+    m_discipline = DISC_WFQ;
+  } else {
+    throw cRuntimeError("unknown scheduling discipline '%s'", discipline);
+  }
+
+  if (n_classes == 0) {
+    throw cRuntimeError("there must be at least one traffic class");
+  }
+  m_n_classes = n_classes;
+
+  // get per-class weights. all classes have the same weight by default
+  m_weights = cStringTokenizer(weights).asDoubleVector();
+  if (m_weights.empty()) {
+    m_weights.resize(m_n_classes, 1.0);
+  } else if (m_weights.size() != m_n_classes) {
+    throw cRuntimeError("scheduler weights must have one entry per class");
+  }
+  for (uint8_t i = 0; i < m_n_classes; i++) {
+    if (m_weights[i] <= 0.0) {
+      throw cRuntimeError("scheduler weights must be positive");
+    }
+  }
+
+  m_quantum = quantum;
+  m_capacity = capacity;
+  ASSERT(m_quantum > 0);
+
+  // a fifo scheduler puts all packets into the same queue
+  uint8_t n_queues = (m_discipline == DISC_FIFO) ? 1 : m_n_classes;
+  m_queues = new cPacketQueue[n_queues];
+  m_length = 0;
+
+  // set up order of the packets within the queues
+  cQueue::CompareFunc compare;
+  if (strcmp(order, "fifo") == 0) {
+    compare = NULL;
+  } else if (strcmp(order, "hop") == 0) {
+    compare = compare_hop_cnt;
+  } else if (strcmp(order, "age") == 0) {
+    compare = compare_age;
+  } else {
+    throw cRuntimeError("unknown queue order '%s'", order);
+  }
+
+  // wfq keeps the finish tags of a class in arrival order. they only match
+  // the packets at the head of the queue if the packets stay in that order
+  if ((m_discipline == DISC_WFQ) && compare) {
+    throw cRuntimeError("wfq scheduling requires fifo queue order");
+  }
+  if (compare) {
+    for (uint8_t i = 0; i < n_queues; i++) {
+      m_queues[i].setup(compare);
+    }
+  }
+
+  // per-class quanta of deficit round robin. a class must receive at least one
+  // byte per round, otherwise its deficit never grows and it is never served
+  if (m_discipline == DISC_DRR) {
+    for (uint8_t i = 0; i < m_n_classes; i++) {
+      m_drr_quanta.push_back((int64_t)(m_quantum * m_weights[i]));
+      if (m_drr_quanta[i] < 1) {
+        throw cRuntimeError("drr quantum of class %d (quantum * weight) is "
+                            "below one byte",
+                            i);
+      }
+    }
+  }
+  m_deficits.resize(m_n_classes, 0);
+  m_drr_class = 0;
+  m_drr_class_visited = false;
+
+  m_finish_tags.resize(m_n_classes);
+  m_last_finish_tags.resize(m_n_classes, 0.0);
+  m_virtual_time = 0.0;
+}
+
+PacketScheduler::~PacketScheduler()
+{
+  // packets still waiting in the queues are deleted along with them
+  uint8_t n_queues = (m_discipline == DISC_FIFO) ? 1 : m_n_classes;
+  for (uint8_t i = 0; i < n_queues; i++) {
+    Profiler::report_dequeue(m_queues[i].getLength(),
+                             m_queues[i].getByteLength());
+  }
+  delete[] m_queues;
+}
+
+bool PacketScheduler::insert(cPacket *pkt)
+{
+  // reject packet if the queue is full
+  if ((m_capacity > 0) && (m_length >= m_capacity)) {
+    return false;
+  }
+
+  if (m_discipline == DISC_FIFO) {
+    m_queues[0].insert(pkt);
+  } else {
+    uint8_t traffic_class = get_traffic_class(pkt);
+
+    if (m_discipline == DISC_WFQ) {
+      // the packet's virtual finish tag is the time it would have finished
+      // transmission in a fluid system serving the classes by their weights
+      double start_tag =
+          std::max(m_virtual_time, m_last_finish_tags[traffic_class]);
+      double finish_tag =
+          start_tag + pkt->getByteLength() / m_weights[traffic_class];
+      m_finish_tags[traffic_class].push_back(finish_tag);
+      m_last_finish_tags[traffic_class] = finish_tag;
+    }
+
+    m_queues[traffic_class].insert(pkt);
+  }
+
+  m_length++;
+  Profiler::report_enqueue(pkt->getByteLength());
+  return true;
+}
+
+cPacket *PacketScheduler::pop()
+{
+  ASSERT(is_empty() == false);
+
+  // select the class to serve next
+  uint8_t traffic_class;
+  if (m_discipline == DISC_FIFO) {
+    traffic_class = 0;
+  } else if (m_discipline == DISC_SP) {
+    for (traffic_class = 0; traffic_class < m_n_classes; traffic_class++) {
+      if (m_queues[traffic_class].isEmpty() == false) {
+        break;
+      }
+    }
+  } else if (m_discipline == DISC_DRR) {
+    traffic_class = select_class_drr();
+  } else {
+    traffic_class = select_class_wfq();
+  }
+  ASSERT(traffic_class < m_n_classes);
+
+  m_length--;
+  cPacket *pkt = m_queues[traffic_class].pop();
+  Profiler::report_dequeue(1, pkt->getByteLength());
+  return pkt;
+}
+
+uint8_t PacketScheduler::select_class_drr()
+{
+  while (true) {
+    cPacketQueue &queue = m_queues[m_drr_class];
+
+    if (queue.isEmpty() == false) {
+      // the class receives its quantum once per round
+      if (m_drr_class_visited == false) {
+        m_deficits[m_drr_class] += m_drr_quanta[m_drr_class];
+        m_drr_class_visited = true;
+      }
+
+      // serve the head-of-line packet if the deficit allows it. the class
+      // stays selected as long as it has packets and deficit left
+      int64_t len = queue.front()->getByteLength();
+      if (m_deficits[m_drr_class] >= len) {
+        m_deficits[m_drr_class] -= len;
+        uint8_t traffic_class = m_drr_class;
+        if (queue.getLength() == 1) {
+          // class runs empty. it does not keep its deficit
+          m_deficits[m_drr_class] = 0;
+          m_drr_class = (m_drr_class + 1) % m_n_classes;
+          m_drr_class_visited = false;
+        }
+        return traffic_class;
+      }
+    } else {
+      m_deficits[m_drr_class] = 0;
+    }
+
+    // move on to the next class
+    m_drr_class = (m_drr_class + 1) % m_n_classes;
+    m_drr_class_visited = false;
+  }
+}
+
+uint8_t PacketScheduler::select_class_wfq()
+{
+  // serve the head-of-line packet with the smallest finish tag
+  int16_t traffic_class = -1;
+  for (uint8_t i = 0; i < m_n_classes; i++) {
+    if (m_finish_tags[i].empty()) {
+      continue;
+    }
+    if ((traffic_class < 0) ||
+        (m_finish_tags[i].front() < m_finish_tags[traffic_class].front())) {
+      traffic_class = i;
+    }
+  }
+  ASSERT(traffic_class >= 0);
+
+  // virtual time advances to the finish tag of the packet in service
+  m_virtual_time = m_finish_tags[traffic_class].front();
+  m_finish_tags[traffic_class].pop_front();
+
+  return traffic_class;
+}
+
+bool PacketScheduler::is_empty() { return m_length == 0; }
+
+uint32_t PacketScheduler::get_length() { return m_length; }
+
+uint8_t PacketScheduler::get_traffic_class(cPacket *pkt)
+{
+  // control messages are always sent with the highest priority
+  if (pkt->getKind() != MSG_KIND_PACKET_DATA) {
+    return 0;
+  }
+
+  // classes beyond the configured number of classes share the lowest priority
+  uint8_t traffic_class = ((Packet *)pkt)->get_traffic_class();
+  if (traffic_class >= m_n_classes) {
+    traffic_class = m_n_classes - 1;
+  }
+  return traffic_class;
+}
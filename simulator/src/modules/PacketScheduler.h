@@ -0,0 +1,59 @@
+#ifndef MODULES_PACKETSCHEDULER_H_
+#define MODULES_PACKETSCHEDULER_H_
+
+#include <deque>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+// packet queue with one fifo per traffic class. packets are dequeued according
+// to the configured scheduling discipline: "fifo" ignores traffic classes, "sp"
+// (strict priority) always serves the lowest non-empty class, "drr" (deficit
+// round robin) and "wfq" (self-clocked weighted fair queueing) share the
+// bandwidth among classes according to their weights. within a class, packets
+// are kept in arrival order ("fifo"), ordered by decreasing hop count ("hop")
+// or by increasing generation time ("age"), so that packets which have already
+// been offloaded are not delayed behind fresh arrivals once again. wfq only
+// supports the "fifo" order. the queue optionally has a capacity (in packets),
+// beyond which arriving packets are rejected
+class PacketScheduler
+{
+public:
+  PacketScheduler(const char *discipline, const char *order, uint8_t n_classes,
+                  const char *weights, uint32_t quantum, uint32_t capacity);
+  virtual ~PacketScheduler();
+
+  bool insert(cPacket *pkt);
+  cPacket *pop();
+  bool is_empty();
+  uint32_t get_length();
+  uint8_t get_traffic_class(cPacket *pkt);
+
+private:
+  typedef enum { DISC_FIFO, DISC_SP, DISC_DRR, DISC_WFQ } discipline_t;
+
+  uint8_t select_class_drr();
+  uint8_t select_class_wfq();
+
+  discipline_t m_discipline;
+  uint8_t m_n_classes;
+  std::vector<double> m_weights;
+  uint32_t m_quantum;
+  uint32_t m_capacity;
+
+  cPacketQueue *m_queues;
+  uint32_t m_length;
+
+  // deficit round robin state
+  std::vector<int64_t> m_drr_quanta;
+  std::vector<int64_t> m_deficits;
+  uint8_t m_drr_class;
+  bool m_drr_class_visited;
+
+  // weighted fair queueing state
+  std::vector<std::deque<double>> m_finish_tags;
+  std::vector<double> m_last_finish_tags;
+  double m_virtual_time;
+};
+
+#endif
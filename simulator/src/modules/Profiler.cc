@@ -0,0 +1,119 @@
+#include "Profiler.h"
+#include <fstream>
+#include <iostream>
+
+Define_Module(Profiler);
+
+bool Profiler::s_enabled = false;
+std::vector<Profiler::type_t> Profiler::s_types;
+uint64_t Profiler::s_n_pkts_allocated = 0;
+uint64_t Profiler::s_n_pkts_live = 0;
+uint64_t Profiler::s_n_pkts_live_max = 0;
+uint64_t Profiler::s_n_pkts_queued = 0;
+uint64_t Profiler::s_n_pkts_queued_max = 0;
+int64_t Profiler::s_n_bytes_queued = 0;
+int64_t Profiler::s_n_bytes_queued_max = 0;
+
+Profiler::Profiler()
+{
+  // reset counters of a previous run executed by the same process. this is
+  // done on construction, because other modules allocate packets in their
+  // initialize(). packets still alive are left over from the previous run
+  // and deleted along with its network
+  for (size_t i = 0; i < s_types.size(); i++) {
+    s_types[i].n_events = 0;
+    s_types[i].t_wall_ns = 0;
+  }
+  s_n_pkts_allocated = 0;
+  s_n_pkts_live_max = s_n_pkts_live;
+  s_n_pkts_queued_max = s_n_pkts_queued;
+  s_n_bytes_queued_max = s_n_bytes_queued;
+}
+
+Profiler::~Profiler() { s_enabled = false; }
+
+uint16_t Profiler::register_type(const char *name)
+{
+  type_t type = {name, 0, 0};
+  s_types.push_back(type);
+  return s_types.size() - 1;
+}
+
+void Profiler::report_event(uint16_t type_id, int64_t t_wall_ns)
+{
+  s_types[type_id].n_events++;
+  s_types[type_id].t_wall_ns += t_wall_ns;
+}
+
+void Profiler::initialize()
+{
+  s_enabled = true;
+  m_t_start = std::chrono::steady_clock::now();
+}
+
+void Profiler::handleMessage(cMessage *msg)
+{
+  throw cRuntimeError("this module should not receive messages");
+}
+
+void Profiler::finish()
+{
+  std::chrono::duration<double> t_wall =
+      std::chrono::steady_clock::now() - m_t_start;
+
+  // per module type
+  for (size_t i = 0; i < s_types.size(); i++) {
+    const type_t &type = s_types[i];
+    std::string prefix = "profile_" + type.name;
+    recordScalar((prefix + "_n_events").c_str(), type.n_events);
+    recordScalar((prefix + "_t_wall").c_str(), type.t_wall_ns * 1e-9);
+    if (type.n_events > 0) {
+      recordScalar((prefix + "_t_wall_per_event").c_str(),
+                   type.t_wall_ns * 1e-9 / type.n_events);
+    }
+  }
+
+  // whole run
+  recordScalar("profile_n_events", getSimulation()->getEventNumber());
+  recordScalar("profile_t_wall", t_wall.count());
+  recordScalar("profile_n_pkts_allocated", s_n_pkts_allocated);
+  recordScalar("profile_n_pkts_in_flight_max", s_n_pkts_live_max);
+  recordScalar("profile_n_pkts_queued_max", s_n_pkts_queued_max);
+  recordScalar("profile_n_bytes_queued_max", s_n_bytes_queued_max);
+
+  // summary, written to stdout unless a file is given
+  const char *filename_summary = par("filename_summary");
+  if (strlen(filename_summary) == 0) {
+    write_summary(std::cout, t_wall.count());
+  } else {
+    std::ofstream file(filename_summary);
+    if (file.is_open() == false) {
+      throw cRuntimeError("could not create profiling summary file");
+    }
+    write_summary(file, t_wall.count());
+  }
+}
+
+void Profiler::write_summary(std::ostream &os, double t_wall)
+{
+  char line[128];
+
+  os << "profiling summary (wall time " << t_wall << " s, "
+     << getSimulation()->getEventNumber() << " events)\n";
+  sprintf(line, "%-24s %12s %12s %8s %12s\n", "module type", "events",
+          "wall [s]", "share", "per event");
+  os << line;
+  for (size_t i = 0; i < s_types.size(); i++) {
+    const type_t &type = s_types[i];
+    double t = type.t_wall_ns * 1e-9;
+    sprintf(line, "%-24s %12lu %12.3f %7.1f%% %10.0fns\n", type.name.c_str(),
+            (unsigned long)type.n_events, t,
+            (t_wall > 0.0) ? 100.0 * t / t_wall : 0.0,
+            (type.n_events > 0) ? 1e9 * t / type.n_events : 0.0);
+    os << line;
+  }
+  os << "packets allocated: " << s_n_pkts_allocated
+     << ", max. in flight: " << s_n_pkts_live_max
+     << ", max. queued: " << s_n_pkts_queued_max << " ("
+     << s_n_bytes_queued_max << " bytes)\n";
+}
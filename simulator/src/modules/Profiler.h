@@ -0,0 +1,108 @@
+#ifndef MODULES_PROFILER_H_
+#define MODULES_PROFILER_H_
+
+#include <chrono>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+// profiles the simulator itself. counts the events and measures the wall time
+// spent in handleMessage() per module type, and tracks packet allocations as
+// well as the peak number of packets in flight and queued. profiling of the
+// event handlers is only active if the network contains a Profiler module.
+// the packet and queue counters are cheap and always maintained, so that they
+// stay consistent regardless of when profiling is enabled. work done by direct
+// calls (fast path) is accounted to the module whose event handler makes them
+class Profiler : public cSimpleModule
+{
+public:
+  Profiler();
+  virtual ~Profiler();
+
+  static uint16_t register_type(const char *name);
+  static bool is_enabled() { return s_enabled; }
+  static void report_event(uint16_t type_id, int64_t t_wall_ns);
+
+  static void report_pkt_alloc()
+  {
+    s_n_pkts_allocated++;
+    if (++s_n_pkts_live > s_n_pkts_live_max) {
+      s_n_pkts_live_max = s_n_pkts_live;
+    }
+  }
+  static void report_pkt_free() { s_n_pkts_live--; }
+
+  static void report_enqueue(int64_t n_bytes)
+  {
+    if (++s_n_pkts_queued > s_n_pkts_queued_max) {
+      s_n_pkts_queued_max = s_n_pkts_queued;
+    }
+    s_n_bytes_queued += n_bytes;
+    if (s_n_bytes_queued > s_n_bytes_queued_max) {
+      s_n_bytes_queued_max = s_n_bytes_queued;
+    }
+  }
+  static void report_dequeue(uint64_t n_pkts, int64_t n_bytes)
+  {
+    s_n_pkts_queued -= n_pkts;
+    s_n_bytes_queued -= n_bytes;
+  }
+
+protected:
+  virtual void initialize();
+  virtual void handleMessage(cMessage *msg);
+  virtual void finish();
+
+private:
+  typedef struct {
+    std::string name;  // module type
+    uint64_t n_events; // events handled
+    int64_t t_wall_ns; // wall time spent handling them
+  } type_t;
+
+  void write_summary(std::ostream &os, double t_wall);
+
+  std::chrono::steady_clock::time_point m_t_start;
+
+  static bool s_enabled;
+  static std::vector<type_t> s_types;
+  static uint64_t s_n_pkts_allocated;
+  static uint64_t s_n_pkts_live;
+  static uint64_t s_n_pkts_live_max;
+  static uint64_t s_n_pkts_queued;
+  static uint64_t s_n_pkts_queued_max;
+  static int64_t s_n_bytes_queued;
+  static int64_t s_n_bytes_queued_max;
+};
+
+// measures the wall time of the enclosing scope if profiling is enabled
+class ProfileScope
+{
+public:
+  ProfileScope(uint16_t type_id) : m_type_id(type_id)
+  {
+    if (Profiler::is_enabled()) {
+      m_t_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ProfileScope()
+  {
+    if (Profiler::is_enabled()) {
+      std::chrono::nanoseconds t =
+          std::chrono::steady_clock::now() - m_t_start;
+      Profiler::report_event(m_type_id, t.count());
+    }
+  }
+
+private:
+  uint16_t m_type_id;
+  std::chrono::steady_clock::time_point m_t_start;
+};
+
+// placed at the top of a module's handleMessage()
+#define PROFILE_HANDLE_MESSAGE(type)                                           \
+  static uint16_t profile_type_id = Profiler::register_type(type);            \
+  ProfileScope profile_scope(profile_type_id)
+
+#endif
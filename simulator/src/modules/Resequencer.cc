@@ -0,0 +1,239 @@
+#include "Resequencer.h"
+#include "../defines.h"
+#include "../msgs/Packet.h"
+#include "Profiler.h"
+
+Define_Module(Resequencer);
+
+Resequencer::~Resequencer()
+{
+  cancelAndDelete(m_self_msg);
+
+  // delete packets that are still being held
+  std::map<uint64_t, flow_state_t>::iterator it;
+  for (it = m_flows.begin(); it != m_flows.end(); it++) {
+    std::map<uint64_t, Packet *>::iterator it_pkt;
+    for (it_pkt = it->second.held_pkts.begin();
+         it_pkt != it->second.held_pkts.end(); it_pkt++) {
+      delete it_pkt->second;
+    }
+  }
+  m_flows.clear();
+}
+
+void Resequencer::initialize()
+{
+  // get the max. duration an out-of-order packet is held back
+  m_timeout = par("timeout");
+  ASSERT(m_timeout > 0);
+
+  // number of input gates must match number of output gates
+  ASSERT(gateSize("in") == gateSize("out"));
+
+  // create self-message triggered when the oldest held packet times out
+  m_self_msg = new cMessage();
+
+  // initially buffer is empty
+  m_n_buffer_pkts = 0;
+  m_n_buffer_bytes = 0;
+
+  // register statistic signals
+  m_sig_stats_reseq_lat = registerSignal("stats_reseq_lat");
+  m_sig_stats_reseq_buffer_pkts = registerSignal("stats_reseq_buffer_pkts");
+  m_sig_stats_reseq_buffer_bytes = registerSignal("stats_reseq_buffer_bytes");
+  m_sig_stats_reseq_n_held_pkts = registerSignal("stats_reseq_n_held_pkts");
+  m_sig_stats_reseq_n_timeout_releases =
+      registerSignal("stats_reseq_n_timeout_releases");
+  m_sig_stats_reseq_n_late_pkts = registerSignal("stats_reseq_n_late_pkts");
+}
+
+void Resequencer::handleMessage(cMessage *msg)
+{
+  PROFILE_HANDLE_MESSAGE("Resequencer");
+
+  if (msg->isSelfMessage()) {
+    // one or more held packets timed out
+    handle_timeouts();
+  } else {
+    // only data packets must arrive here!
+    ASSERT(msg->getKind() == MSG_KIND_PACKET_DATA);
+    handle_packet((Packet *)msg);
+  }
+}
+
+void Resequencer::handle_packet(Packet *pkt)
+{
+  // get flow and packet id
+  uint64_t flow_key = pkt->get_flow().get_key();
+  uint64_t pkt_id = pkt->get_id();
+
+  // get flow state. if the flow has not been seen yet or its state has been
+  // removed after it has been idle, a new state is created that starts with
+  // the arriving packet. predecessors arriving later are late packets, just
+  // like ones the resequencer has given up waiting for
+  std::map<uint64_t, flow_state_t>::iterator it = m_flows.find(flow_key);
+  if (it == m_flows.end()) {
+    flow_state_t state;
+    state.nxt_expected_pkt_id = pkt_id;
+    state.n_timeouts = 0;
+    state.idle_check = false;
+    it = m_flows.insert(std::pair<uint64_t, flow_state_t>(flow_key, state))
+             .first;
+  }
+  flow_state_t &state = it->second;
+  state.t_last_arrival = simTime();
+
+  if (pkt_id == state.nxt_expected_pkt_id) {
+    // packet is in order. release it and all held packets that are now in
+    // order as well
+    release_packet(pkt, false);
+    state.nxt_expected_pkt_id++;
+    release_in_order(state);
+  } else if (pkt_id > state.nxt_expected_pkt_id) {
+    // packet overtook one of its predecessors. hold it back until the gap is
+    // filled or the timeout expires
+    state.held_pkts.insert(std::pair<uint64_t, Packet *>(pkt_id, pkt));
+    emit(m_sig_stats_reseq_n_held_pkts, 1);
+
+    // update buffer occupancy
+    m_n_buffer_pkts++;
+    m_n_buffer_bytes += pkt->getByteLength();
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_reseq_buffer_pkts, m_n_buffer_pkts);
+      emit(m_sig_stats_reseq_buffer_bytes, m_n_buffer_bytes);
+    }
+
+    // remember when the packet has to be released at the latest
+    timeout_t timeout;
+    timeout.t_release = simTime() + m_timeout;
+    timeout.flow_key = flow_key;
+    timeout.pkt_id = pkt_id;
+    timeout.idle_check = false;
+    m_timeouts.push_back(timeout);
+    state.n_timeouts++;
+    schedule_timeout();
+  } else {
+    // packet arrives after the resequencer has already given up waiting for it
+    // (i.e. its successors have been released on timeout). nothing we can do
+    // anymore, release it right away
+    emit(m_sig_stats_reseq_n_late_pkts, 1);
+    release_packet(pkt, false);
+  }
+
+  // check later whether the flow has become idle, so that its state can be
+  // removed
+  if (!state.idle_check) {
+    schedule_idle_check(flow_key, state);
+  }
+}
+
+void Resequencer::handle_timeouts()
+{
+  // process all timeouts that have expired by now
+  while (!m_timeouts.empty() && (m_timeouts.front().t_release <= simTime())) {
+    timeout_t timeout = m_timeouts.front();
+    m_timeouts.pop_front();
+
+    std::map<uint64_t, flow_state_t>::iterator it =
+        m_flows.find(timeout.flow_key);
+    ASSERT(it != m_flows.end());
+    flow_state_t &state = it->second;
+
+    if (timeout.idle_check) {
+      // remove the flow's state if it has neither held packets nor pending
+      // timeouts and no packet has arrived for a whole timeout. a packet
+      // missing for that long would have been given up on anyway. otherwise
+      // check again later
+      state.idle_check = false;
+      if (state.held_pkts.empty() && (state.n_timeouts == 0) &&
+          (state.t_last_arrival + m_timeout <= simTime())) {
+        m_flows.erase(it);
+      } else {
+        schedule_idle_check(timeout.flow_key, state);
+      }
+      continue;
+    }
+    ASSERT(state.n_timeouts > 0);
+    state.n_timeouts--;
+
+    // the packet may already have been released, because the gap was filled in
+    // the meantime
+    if (state.held_pkts.find(timeout.pkt_id) == state.held_pkts.end()) {
+      continue;
+    }
+
+    // stop waiting for the missing packet(s). release all held packets up to
+    // and including the timed out one
+    emit(m_sig_stats_reseq_n_timeout_releases, 1);
+    state.nxt_expected_pkt_id = timeout.pkt_id;
+    while (state.held_pkts.begin()->first < timeout.pkt_id) {
+      Packet *pkt = state.held_pkts.begin()->second;
+      state.held_pkts.erase(state.held_pkts.begin());
+      release_packet(pkt, true);
+    }
+    release_in_order(state);
+  }
+
+  schedule_timeout();
+}
+
+void Resequencer::schedule_idle_check(uint64_t flow_key, flow_state_t &state)
+{
+  // idle checks are queued along with the timeouts of the held packets
+  timeout_t timeout;
+  timeout.t_release = simTime() + m_timeout;
+  timeout.flow_key = flow_key;
+  timeout.pkt_id = 0;
+  timeout.idle_check = true;
+  m_timeouts.push_back(timeout);
+  state.idle_check = true;
+  schedule_timeout();
+}
+
+void Resequencer::release_in_order(flow_state_t &state)
+{
+  // release held packets as long as they are in order
+  while (!state.held_pkts.empty() &&
+         (state.held_pkts.begin()->first == state.nxt_expected_pkt_id)) {
+    Packet *pkt = state.held_pkts.begin()->second;
+    state.held_pkts.erase(state.held_pkts.begin());
+    release_packet(pkt, true);
+    state.nxt_expected_pkt_id++;
+  }
+}
+
+void Resequencer::release_packet(Packet *pkt, bool held)
+{
+  // calculate how long the packet has been held back
+  simtime_t t_held = simTime() - pkt->getArrivalTime();
+
+  if (held) {
+    // packet has been buffered. update buffer occupancy
+    ASSERT(m_n_buffer_pkts > 0);
+    m_n_buffer_pkts--;
+    m_n_buffer_bytes -= pkt->getByteLength();
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_reseq_buffer_pkts, m_n_buffer_pkts);
+      emit(m_sig_stats_reseq_buffer_bytes, m_n_buffer_bytes);
+    }
+  }
+
+  // record the added latency
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_reseq_lat, t_held);
+  }
+  LatencyElement *latency_reseq =
+      new LatencyElement(LatencyElement::RESEQ, t_held);
+  pkt->get_latency()->add_element(latency_reseq);
+
+  // send packet out on the port matching its arrival port
+  send(pkt, "out", pkt->getArrivalGate()->getIndex());
+}
+
+void Resequencer::schedule_timeout()
+{
+  // (re-)schedule self-message for the oldest pending timeout
+  if (!m_timeouts.empty() && !m_self_msg->isScheduled()) {
+    scheduleAt(m_timeouts.front().t_release, m_self_msg);
+  }
+}
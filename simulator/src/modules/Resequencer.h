@@ -0,0 +1,65 @@
+#ifndef MODULES_RESEQUENCER_H_
+#define MODULES_RESEQUENCER_H_
+
+#include <deque>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+class Packet;
+
+class Resequencer : public cSimpleModule
+{
+public:
+  virtual ~Resequencer();
+
+protected:
+  virtual void initialize();
+  virtual void handleMessage(cMessage *msg);
+
+private:
+  typedef struct {
+    uint64_t nxt_expected_pkt_id;
+    // out-of-order packets waiting for the gap to be filled, sorted by id
+    std::map<uint64_t, Packet *> held_pkts;
+    uint32_t n_timeouts;      // pending timeouts of held packets
+    simtime_t t_last_arrival; // arrival time of the flow's latest packet
+    bool idle_check;          // idle check of the flow pending?
+  } flow_state_t;
+
+  typedef struct {
+    simtime_t t_release; // time at which the packet is released at the latest
+    uint64_t flow_key;
+    uint64_t pkt_id;
+    bool idle_check; // no packet, check whether the flow's state may be removed
+  } timeout_t;
+
+  void handle_packet(Packet *pkt);
+  void handle_timeouts();
+  void schedule_idle_check(uint64_t flow_key, flow_state_t &state);
+  void release_in_order(flow_state_t &state);
+  void release_packet(Packet *pkt, bool held);
+  void schedule_timeout();
+
+  simtime_t m_timeout;
+
+  std::map<uint64_t, flow_state_t> m_flows;
+
+  // pending timeouts and idle checks. since all packets are held for the same
+  // duration and flows are checked for idleness after that duration as well,
+  // new entries are always appended at the back
+  std::deque<timeout_t> m_timeouts;
+  cMessage *m_self_msg;
+
+  uint64_t m_n_buffer_pkts;
+  uint64_t m_n_buffer_bytes;
+
+  simsignal_t m_sig_stats_reseq_lat;
+  simsignal_t m_sig_stats_reseq_buffer_pkts;
+  simsignal_t m_sig_stats_reseq_buffer_bytes;
+  simsignal_t m_sig_stats_reseq_n_held_pkts;
+  simsignal_t m_sig_stats_reseq_n_timeout_releases;
+  simsignal_t m_sig_stats_reseq_n_late_pkts;
+};
+
+#endif
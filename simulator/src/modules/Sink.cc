@@ -1,9 +1,54 @@
 #include "Sink.h"
 #include "../defines.h"
 #include "../msgs/Packet.h"
+#include "Profiler.h"
+#include <algorithm>
 
 Define_Module(Sink);
 
+// quantile of the student t distribution with the given degrees of freedom,
+// approximated by the cornish-fisher expansion around the normal quantile
+static double calc_t_quantile(double p, uint32_t dof)
+{
+  // normal quantile by bisection on the normal cdf
+  double lo = -10.0, hi = 10.0;
+  for (int i = 0; i < 100; i++) {
+    double z = (lo + hi) / 2.0;
+    if (0.5 * erfc(-z / sqrt(2.0)) < p) {
+      lo = z;
+    } else {
+      hi = z;
+    }
+  }
+  double z = (lo + hi) / 2.0;
+
+  double z3 = z * z * z;
+  double z5 = z3 * z * z;
+  double z7 = z5 * z * z;
+  double v = dof;
+  return z + (z3 + z) / (4.0 * v) +
+         (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * v * v) +
+         (3.0 * z7 + 19.0 * z5 + 17.0 * z3 - 15.0 * z) / (384.0 * v * v * v);
+}
+
+// sample mean and confidence interval half-width of a set of batch values
+static void calc_ci(const std::vector<double> &values, double t_quantile,
+                    double *mean, double *hw)
+{
+  size_t n = values.size();
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum += values[i];
+  }
+  *mean = sum / n;
+
+  double sum_sq = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum_sq += (values[i] - *mean) * (values[i] - *mean);
+  }
+  *hw = t_quantile * sqrt(sum_sq / (n - 1) / n);
+}
+
 Sink::~Sink()
 {
   if (m_enable_reorder_check) {
@@ -13,12 +58,19 @@ Sink::~Sink()
     }
     delete[] m_reorder_check_table;
   }
+
+  if (m_enable_class_stats) {
+    delete[] m_stats_hists_lat_class;
+    delete[] m_stats_lat_class;
+  }
 }
 
 void Sink::initialize()
 {
+  // no packets received so far
+  m_n_pkts = 0;
+
   // register statistic singals
-  m_stats_sig_n_packets = registerSignal("stats_n_packets");
   m_stats_sig_hop_cnt = registerSignal("stats_hop_cnt");
 
   // set histogram ranges and number of bins
@@ -45,6 +97,8 @@ void Sink::initialize()
 
   // reorder checking enabled?
   m_enable_reorder_check = par("check_reorder");
+  m_reorder_check_max_pkts = par("check_reorder_max_pkts");
+  m_n_reordered_pkts = 0;
 
   if (m_enable_reorder_check) {
     // initialize reorder check hashtable
@@ -57,10 +111,69 @@ void Sink::initialize()
     m_stats_sig_reorder_check_n_reordered_flows =
         registerSignal("stats_reorder_check_n_reordered_flows");
   }
+
+  // per-class stats enabled?
+  m_enable_class_stats = par("record_class_stats");
+  m_n_traffic_classes = par("n_traffic_classes");
+
+  if (m_enable_class_stats) {
+    m_stats_hists_lat_class = new cHistogram[m_n_traffic_classes];
+    m_stats_lat_class = new simsignal_t[m_n_traffic_classes];
+    m_class_n_pkts.resize(m_n_traffic_classes, 0);
+    for (uint8_t i = 0; i < m_n_traffic_classes; i++) {
+      m_stats_hists_lat_class[i].setRange(0.0, 1.0);
+      m_stats_hists_lat_class[i].setNumBinsHint(1000000);
+
+      // per-class end-to-end latency
+      char signal_name[48];
+      char stats_name[48];
+      sprintf(signal_name, "stats_lat_end_to_end_class%d", i);
+      sprintf(stats_name, "lat_end_to_end_class%d", i);
+      m_stats_lat_class[i] = registerSignal(signal_name);
+      cProperty *statisticsTemplate =
+          getProperties()->get("statisticTemplate", "lat_end_to_end_class");
+      getEnvir()->addResultRecorders(this, m_stats_lat_class[i], stats_name,
+                                     statisticsTemplate);
+    }
+  }
+
+  // steady-state analysis enabled?
+  m_enable_ss = par("steady_state_analysis");
+  m_ss_converged = false;
+  m_ss_result.valid = false;
+
+  if (m_enable_ss) {
+    m_ss_n_batches = par("ss_n_batches");
+    if (m_ss_n_batches < 2) {
+      throw cRuntimeError("steady-state analysis requires at least 2 batches");
+    }
+    double confidence_level = par("ss_confidence_level");
+    if ((confidence_level <= 0.0) || (confidence_level >= 1.0)) {
+      throw cRuntimeError("invalid steady-state confidence level");
+    }
+    m_ss_t_quantile = calc_t_quantile(1.0 - (1.0 - confidence_level) / 2.0,
+                                      m_ss_n_batches - 1);
+    m_ss_target_rel_precision = par("ss_target_rel_precision");
+    m_ss_check_interval = par("ss_check_interval");
+    m_ss_next_check = m_ss_check_interval;
+  }
 }
 
 void Sink::finish()
 {
+  // record number of packets received. kept under the name of the former
+  // count statistic, so that results remain comparable
+  recordScalar("n_packets:count", m_n_pkts);
+
+  // record mean latencies, which are available at every statistics level
+  recordScalar("lat_end_to_end_mean", m_stats_hist_lat_end_to_end.getMean());
+  recordScalar("lat_node_buffer_in_mean",
+               m_stats_hist_lat_node_buffer_in.getMean());
+  recordScalar("lat_node_buffer_out_mean",
+               m_stats_hist_lat_node_buffer_out.getMean());
+  recordScalar("lat_node_proc_mean", m_stats_hist_lat_node_proc.getMean());
+  recordScalar("lat_tor_mean", m_stats_hist_lat_tor.getMean());
+
   // records cdfs
   record_cdf_simtime("lat_end_to_end_cdf", 1000, &m_stats_hist_lat_end_to_end);
   record_cdf_simtime("lat_node_buffer_in", 1000,
@@ -69,15 +182,37 @@ void Sink::finish()
                      &m_stats_hist_lat_node_buffer_out);
   record_cdf_simtime("lat_node_proc", 1000, &m_stats_hist_lat_node_proc);
   record_cdf_simtime("lat_tor", 1000, &m_stats_hist_lat_tor);
+
+  // record per-class stats
+  if (m_enable_class_stats) {
+    class_stats_record();
+  }
+
+  // record steady-state stats, analyzing all packets received
+  if (m_enable_ss) {
+    ss_analyze();
+    ss_record();
+  }
+
+  // fail the run if more packets than expected have been reordered
+  if (m_enable_reorder_check && (m_reorder_check_max_pkts >= 0) &&
+      (m_n_reordered_pkts > (uint64_t)m_reorder_check_max_pkts)) {
+    throw cRuntimeError("%lu packets have been reordered, at most %ld "
+                        "expected",
+                        (unsigned long)m_n_reordered_pkts,
+                        (long)m_reorder_check_max_pkts);
+  }
 }
 
 void Sink::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("Sink");
+
   // only data packets must arrive here!
   ASSERT(msg->getKind() == MSG_KIND_PACKET_DATA);
 
   // increment packet counter
-  emit(m_stats_sig_n_packets, 1);
+  m_n_pkts++;
 
   // cast packet
   Packet *pkt = (Packet *)msg;
@@ -107,33 +242,42 @@ void Sink::handleMessage(cMessage *msg)
   m_stats_hist_lat_node_proc.collect(lat_node_proc);
   m_stats_hist_lat_tor.collect(lat_tor);
 
-  // collect hop count
-  emit(m_stats_sig_hop_cnt, pkt->get_hop_cnt());
+  if (STATS_DETAILED) {
+    // collect hop count
+    emit(m_stats_sig_hop_cnt, pkt->get_hop_cnt());
 
-  // report end-to-end packet latency
-  emit(m_stats_lat_end_to_end, lat_end_to_end);
+    // report end-to-end packet latency
+    emit(m_stats_lat_end_to_end, lat_end_to_end);
 
-  // report buffer latencies
-  emit(m_stats_lat_node_buffer_in, lat_node_buffer_in);
-  emit(m_stats_lat_node_buffer_out, lat_node_buffer_out);
-  emit(m_stats_lat_node_proc, lat_node_proc);
-  emit(m_stats_lat_tor, lat_tor);
+    // report buffer latencies
+    emit(m_stats_lat_node_buffer_in, lat_node_buffer_in);
+    emit(m_stats_lat_node_buffer_out, lat_node_buffer_out);
+    emit(m_stats_lat_node_proc, lat_node_proc);
+    emit(m_stats_lat_tor, lat_tor);
+  }
+
+  // collect per-class stats, if necessary
+  if (m_enable_class_stats) {
+    class_stats_collect(pkt, lat_end_to_end);
+  }
 
   // do reorder check, if necessary
   if (m_enable_reorder_check) {
-    // get flow
-    Flow *flow = pkt->get_flow();
-
     // get packet id
     uint64_t pkt_id = pkt->get_id();
 
-    reorder_check(flow, pkt_id);
+    reorder_check(pkt->get_flow(), pkt_id);
   }
 
   delete pkt;
+
+  // steady-state analysis. may end the simulation, so it is done last
+  if (m_enable_ss) {
+    ss_collect(lat_end_to_end);
+  }
 }
 
-void Sink::reorder_check(Flow *flow, uint64_t pkt_id)
+void Sink::reorder_check(const Flow &flow, uint64_t pkt_id)
 {
   // see if entry for this flow exists in the table
   reorder_check_table_entry_t *entry = reorder_check_find(flow);
@@ -142,6 +286,7 @@ void Sink::reorder_check(Flow *flow, uint64_t pkt_id)
     if ((*entry).nxt_exptected_pkt_id > pkt_id) {
       // reordering!
       entry->reorder_cntr++;
+      m_n_reordered_pkts++;
       emit(m_stats_sig_reorder_check_n_reordered_pkts, 1);
       if (entry->reorder_cntr == 1) {
         emit(m_stats_sig_reorder_check_n_reordered_flows, 1);
@@ -152,27 +297,27 @@ void Sink::reorder_check(Flow *flow, uint64_t pkt_id)
   } else {
     // entry does no exist yet. create it
     reorder_check_table_entry_t entry;
-    entry.flow = flow;
+    entry.flow_key = flow.get_key();
     entry.nxt_exptected_pkt_id = pkt_id + 1;
     entry.reorder_cntr = 0;
 
     // add entry to table
-    m_reorder_check_table[flow->get_toeplitz_hash() % CHECK_HASHTABLE_ENTRIES]
+    m_reorder_check_table[flow.get_toeplitz_hash() % CHECK_HASHTABLE_ENTRIES]
         .push_back(entry);
   }
 }
 
-Sink::reorder_check_table_entry_t *Sink::reorder_check_find(Flow *flow)
+Sink::reorder_check_table_entry_t *Sink::reorder_check_find(const Flow &flow)
 {
   // get toeplitz hash value
-  uint32_t hash = flow->get_toeplitz_hash();
+  uint32_t hash = flow.get_toeplitz_hash();
 
   // iterate over reorder check table
   std::vector<reorder_check_table_entry_t>::iterator it =
       m_reorder_check_table[hash % CHECK_HASHTABLE_ENTRIES].begin();
   for (; it != m_reorder_check_table[hash % CHECK_HASHTABLE_ENTRIES].end();
        it++) {
-    if ((*it).flow == flow) {
+    if ((*it).flow_key == flow.get_key()) {
       // found the entry! return pointer to it
       return &(*it);
     }
@@ -182,6 +327,199 @@ Sink::reorder_check_table_entry_t *Sink::reorder_check_find(Flow *flow)
   return NULL;
 }
 
+void Sink::class_stats_collect(Packet *pkt, simtime_t lat_end_to_end)
+{
+  // get packet's traffic class. classes beyond the configured number of
+  // classes are accounted to the last one
+  uint8_t traffic_class = pkt->get_traffic_class();
+  if (traffic_class >= m_n_traffic_classes) {
+    traffic_class = m_n_traffic_classes - 1;
+  }
+
+  // collect latency
+  m_stats_hists_lat_class[traffic_class].collect(lat_end_to_end);
+  if (STATS_DETAILED) {
+    emit(m_stats_lat_class[traffic_class], lat_end_to_end);
+  }
+
+  // count received packets. packet ids of a flow are consecutive, so the
+  // highest id seen tells how many packets of the flow should have arrived
+  m_class_n_pkts[traffic_class]++;
+  const Flow &flow = pkt->get_flow();
+  std::map<uint64_t, flow_class_stats_t>::iterator it =
+      m_flow_class_stats.find(flow.get_key());
+  if (it == m_flow_class_stats.end()) {
+    flow_class_stats_t stats;
+    stats.traffic_class = flow.get_traffic_class();
+    stats.n_pkts_expected = 0;
+    it = m_flow_class_stats.insert(std::make_pair(flow.get_key(), stats)).first;
+  }
+  if (pkt->get_id() + 1 > it->second.n_pkts_expected) {
+    it->second.n_pkts_expected = pkt->get_id() + 1;
+  }
+}
+
+void Sink::class_stats_record()
+{
+  // sum up the number of expected packets per class
+  std::vector<uint64_t> n_pkts_expected(m_n_traffic_classes, 0);
+  std::map<uint64_t, flow_class_stats_t>::const_iterator it;
+  for (it = m_flow_class_stats.begin(); it != m_flow_class_stats.end(); it++) {
+    uint8_t traffic_class = it->second.traffic_class;
+    if (traffic_class >= m_n_traffic_classes) {
+      traffic_class = m_n_traffic_classes - 1;
+    }
+    n_pkts_expected[traffic_class] += it->second.n_pkts_expected;
+  }
+
+  for (uint8_t i = 0; i < m_n_traffic_classes; i++) {
+    char scalar_name[48];
+
+    // latency cdf
+    if (m_stats_hists_lat_class[i].getCount() > 0) {
+      sprintf(scalar_name, "lat_end_to_end_class%d_cdf", i);
+      record_cdf_simtime(scalar_name, 1000, &m_stats_hists_lat_class[i]);
+    }
+
+    // received and lost packets
+    uint64_t n_pkts_lost = n_pkts_expected[i] - m_class_n_pkts[i];
+    sprintf(scalar_name, "class%d_n_pkts", i);
+    recordScalar(scalar_name, m_class_n_pkts[i]);
+    sprintf(scalar_name, "class%d_n_lost", i);
+    recordScalar(scalar_name, n_pkts_lost);
+    if (n_pkts_expected[i] > 0) {
+      sprintf(scalar_name, "class%d_loss_ratio", i);
+      recordScalar(scalar_name, (double)n_pkts_lost / n_pkts_expected[i]);
+    }
+  }
+}
+
+void Sink::ss_collect(simtime_t lat_end_to_end)
+{
+  m_ss_lats.push_back(SIMTIME_DBL(lat_end_to_end));
+
+  // analysis is repeated every check interval, but at least 10% more packets
+  // must have arrived since the last one. this keeps the total analysis
+  // effort linear in the number of packets
+  if (m_ss_lats.size() < m_ss_next_check) {
+    return;
+  }
+  m_ss_next_check =
+      m_ss_lats.size() + std::max(m_ss_check_interval,
+                                  (uint64_t)(m_ss_lats.size() / 10));
+
+  ss_analyze();
+
+  // end the simulation once the target precision has been reached
+  if ((m_ss_target_rel_precision > 0.0) && ss_is_converged()) {
+    m_ss_converged = true;
+    endSimulation();
+  }
+}
+
+void Sink::ss_analyze()
+{
+  ss_result_t &result = m_ss_result;
+  result.valid = false;
+
+  // discard warm-up, then divide the remaining packets into batches. packets
+  // that do not fill a whole batch are discarded right after the warm-up
+  result.n_warmup = ss_calc_warmup();
+  result.n_batch = (m_ss_lats.size() - result.n_warmup) / m_ss_n_batches;
+  if (result.n_batch < SS_MIN_BATCH_PKTS) {
+    return;
+  }
+
+  // mean and 99th percentile latency of each batch
+  std::vector<double> means(m_ss_n_batches), p99s(m_ss_n_batches);
+  std::vector<float> batch(result.n_batch);
+  size_t p99_idx = (size_t)ceil(0.99 * result.n_batch) - 1;
+  for (uint32_t i = 0; i < m_ss_n_batches; i++) {
+    std::vector<float>::const_iterator begin =
+        m_ss_lats.end() - (m_ss_n_batches - i) * result.n_batch;
+    double sum = 0.0;
+    for (size_t j = 0; j < result.n_batch; j++) {
+      sum += begin[j];
+    }
+    means[i] = sum / result.n_batch;
+
+    batch.assign(begin, begin + result.n_batch);
+    std::nth_element(batch.begin(), batch.begin() + p99_idx, batch.end());
+    p99s[i] = batch[p99_idx];
+  }
+
+  // confidence intervals from the batch values
+  calc_ci(means, m_ss_t_quantile, &result.mean, &result.mean_hw);
+  calc_ci(p99s, m_ss_t_quantile, &result.p99, &result.p99_hw);
+  result.valid = true;
+}
+
+size_t Sink::ss_calc_warmup()
+{
+  // mser-5: average the latencies in batches of 5 and truncate the batches
+  // that minimize the marginal standard error of the remaining ones. only
+  // truncation points within the first half are considered, since the
+  // statistic becomes unstable towards the end
+  size_t n = m_ss_lats.size() / 5;
+  if (n < 2) {
+    return 0;
+  }
+
+  std::vector<double> y(n);
+  for (size_t i = 0; i < n; i++) {
+    double sum = 0.0;
+    for (size_t j = 0; j < 5; j++) {
+      sum += m_ss_lats[5 * i + j];
+    }
+    y[i] = sum / 5.0;
+  }
+
+  // evaluate truncation points from back to front using suffix sums. ties
+  // are resolved in favor of the shorter warm-up
+  double sum = 0.0, sum_sq = 0.0, mser_min = 0.0;
+  size_t d_min = n / 2;
+  for (size_t d = n; d-- > 0;) {
+    sum += y[d];
+    sum_sq += y[d] * y[d];
+    if (d > n / 2) {
+      continue;
+    }
+
+    double m = n - d;
+    double mser = (sum_sq - sum * sum / m) / (m * m);
+    if ((d == n / 2) || (mser <= mser_min)) {
+      d_min = d;
+      mser_min = mser;
+    }
+  }
+
+  return 5 * d_min;
+}
+
+bool Sink::ss_is_converged()
+{
+  const ss_result_t &result = m_ss_result;
+  return result.valid &&
+         (result.mean_hw <= m_ss_target_rel_precision * result.mean) &&
+         (result.p99_hw <= m_ss_target_rel_precision * result.p99);
+}
+
+void Sink::ss_record()
+{
+  recordScalar("ss_n_pkts", m_ss_lats.size());
+  recordScalar("ss_converged", m_ss_converged);
+  if (m_ss_result.valid == false) {
+    return;
+  }
+
+  recordScalar("ss_n_pkts_warmup", m_ss_result.n_warmup);
+  recordScalar("ss_batch_size", m_ss_result.n_batch);
+  recordScalar("ss_lat_end_to_end_mean", m_ss_result.mean);
+  recordScalar("ss_lat_end_to_end_mean_ci", m_ss_result.mean_hw);
+  recordScalar("ss_lat_end_to_end_p99", m_ss_result.p99);
+  recordScalar("ss_lat_end_to_end_p99_ci", m_ss_result.p99_hw);
+}
+
 void Sink::record_cdf_simtime(const char *scalar_name, uint16_t n_steps,
                               cHistogram *hist)
 {
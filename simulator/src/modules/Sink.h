@@ -7,7 +7,12 @@ using namespace omnetpp;
 
 #define CHECK_HASHTABLE_ENTRIES 65536
 
+// min. number of packets per batch for the batch means of the 99th percentile
+// latency to be meaningful
+#define SS_MIN_BATCH_PKTS 1000
+
 struct Flow;
+class Packet;
 
 class Sink : public cSimpleModule
 {
@@ -21,18 +26,42 @@ protected:
 
 private:
   typedef struct {
-    Flow *flow;
+    bool valid;       // enough packets for the analysis?
+    size_t n_warmup;  // packets discarded as warm-up
+    size_t n_batch;   // packets per batch
+    double mean;      // mean latency
+    double mean_hw;   // half-width of the mean's confidence interval
+    double p99;       // 99th percentile latency
+    double p99_hw;    // half-width of the 99th percentile's confidence interval
+  } ss_result_t;
+
+  typedef struct {
+    uint64_t flow_key;
     uint64_t nxt_exptected_pkt_id;
     uint64_t reorder_cntr;
   } reorder_check_table_entry_t;
 
-  void reorder_check(Flow *flow, uint64_t pkt_id);
-  reorder_check_table_entry_t *reorder_check_find(Flow *flow);
+  typedef struct {
+    uint8_t traffic_class;
+    uint64_t n_pkts_expected;
+  } flow_class_stats_t;
+
+  void reorder_check(const Flow &flow, uint64_t pkt_id);
+  reorder_check_table_entry_t *reorder_check_find(const Flow &flow);
+
+  void class_stats_collect(Packet *pkt, simtime_t lat_end_to_end);
+  void class_stats_record();
+
+  void ss_collect(simtime_t lat_end_to_end);
+  void ss_analyze();
+  size_t ss_calc_warmup();
+  bool ss_is_converged();
+  void ss_record();
 
   void record_cdf_simtime(const char *scalar_name, uint16_t n_steps,
                           cHistogram *hist);
 
-  simsignal_t m_stats_sig_n_packets;
+  uint64_t m_n_pkts;
   simsignal_t m_stats_sig_hop_cnt;
 
   cHistogram m_stats_hist_lat_end_to_end;
@@ -48,10 +77,29 @@ private:
   simsignal_t m_stats_lat_tor;
 
   bool m_enable_reorder_check;
+  int64_t m_reorder_check_max_pkts;
+  uint64_t m_n_reordered_pkts;
   std::vector<reorder_check_table_entry_t> *m_reorder_check_table;
 
   simsignal_t m_stats_sig_reorder_check_n_reordered_pkts;
   simsignal_t m_stats_sig_reorder_check_n_reordered_flows;
+
+  bool m_enable_class_stats;
+  uint8_t m_n_traffic_classes;
+  cHistogram *m_stats_hists_lat_class;
+  simsignal_t *m_stats_lat_class;
+  std::vector<uint64_t> m_class_n_pkts;
+  std::map<uint64_t, flow_class_stats_t> m_flow_class_stats;
+
+  bool m_enable_ss;
+  uint32_t m_ss_n_batches;
+  double m_ss_t_quantile;
+  double m_ss_target_rel_precision;
+  uint64_t m_ss_check_interval;
+  uint64_t m_ss_next_check;
+  std::vector<float> m_ss_lats; // end-to-end latencies in order of arrival
+  ss_result_t m_ss_result;
+  bool m_ss_converged;
 };
 
 #endif
@@ -1,10 +1,19 @@
 #include "TorSwitch.h"
+#include "../defines.h"
+#include "../msgs/FlowControlMsg_m.h"
+#include "../msgs/InFlightReleaseMsg_m.h"
 #include "../msgs/Packet.h"
+#include "PacketScheduler.h"
+#include "Profiler.h"
+#include <map>
 
 Define_Module(TorSwitch);
 
 TorSwitch::~TorSwitch()
 {
+  for (uint8_t i = 0; i < m_n_ports_nodes; i++) {
+    delete m_queues[i];
+  }
   delete[] m_queues;
   delete[] m_channels_nodes;
 
@@ -14,6 +23,8 @@ TorSwitch::~TorSwitch()
   }
 
   delete[] m_self_msgs;
+  delete[] m_sigs_stats_port_paused;
+  delete[] m_sigs_stats_port_hol_blocked;
 }
 
 void TorSwitch::initialize()
@@ -29,7 +40,14 @@ void TorSwitch::initialize()
   ASSERT(m_n_ports_nodes == n_ports_sinks);
 
   // create packet queues for ports connected to nodes
-  m_queues = new cPacketQueue[m_n_ports_nodes];
+  m_queues = new PacketScheduler *[m_n_ports_nodes];
+  for (uint8_t i = 0; i < m_n_ports_nodes; i++) {
+    m_queues[i] = new PacketScheduler(
+        par("scheduler"), par("scheduler_order"), par("n_traffic_classes"),
+        par("scheduler_weights"), par("scheduler_quantum"),
+        par("queue_capacity"));
+  }
+  m_sig_stats_drop_class = registerSignal("stats_drop_class");
 
   // create array of transmission channels connected to nodes
   m_channels_nodes = new cChannel *[m_n_ports_nodes];
@@ -44,10 +62,84 @@ void TorSwitch::initialize()
     // set self-message's kind to match port id
     m_self_msgs[i].setKind(i);
   }
+
+  // compute departure times from the link rates instead of scheduling an
+  // event per transmitted packet? this requires departures in arrival order
+  m_analytical_departures = par("analytical_departures");
+  m_queue_capacity = par("queue_capacity");
+  m_t_link_free.assign(m_n_ports_nodes, 0);
+  m_t_departures.resize(m_n_ports_nodes);
+  if (m_analytical_departures &&
+      ((strcmp(par("scheduler").stringValue(), "fifo") != 0) ||
+       (strcmp(par("scheduler_order").stringValue(), "fifo") != 0) ||
+       (strcmp(par("flow_control_mode").stringValue(), "none") != 0))) {
+    throw cRuntimeError("analytical departures require fifo scheduling and no "
+                        "flow control");
+  }
+
+  // get flow control parameters
+  m_fc_mode = FlowControl::parse_mode(par("flow_control_mode"));
+  m_fc_xoff = par("fc_xoff");
+  m_fc_xon = par("fc_xon");
+  m_fc_credit_batch = par("fc_credit_batch");
+  ASSERT(m_fc_xon < m_fc_xoff);
+  ASSERT(m_fc_credit_batch > 0);
+  if ((m_fc_mode != FlowControl::FC_NONE) &&
+      (gateSize("fc$o") != m_n_ports_nodes)) {
+    throw cRuntimeError("flow control requires one control link per node");
+  }
+
+  // credits are returned in batches. if a batch is larger than the credits
+  // granted, the node runs out of credits before any are returned
+  if ((m_fc_mode == FlowControl::FC_CREDIT) &&
+      (par("fc_credits").intValue() < m_fc_credit_batch)) {
+    throw cRuntimeError("fc_credits must not be smaller than fc_credit_batch");
+  }
+
+  // register signals for stats collection (flow control)
+  m_sig_stats_n_pause_sent = registerSignal("stats_n_pause_sent");
+  m_sig_stats_hol_blocking_time = registerSignal("stats_hol_blocking_time");
+  m_sigs_stats_port_paused = new simsignal_t[m_n_ports_nodes];
+  m_sigs_stats_port_hol_blocked = new simsignal_t[m_n_ports_nodes];
+  for (uint8_t i = 0; i < m_n_ports_nodes; i++) {
+    char signal_name[32];
+    char stats_name[32];
+    sprintf(signal_name, "stats_port_paused%d", i);
+    sprintf(stats_name, "port_paused%d", i);
+    m_sigs_stats_port_paused[i] = registerSignal(signal_name);
+    getEnvir()->addResultRecorders(
+        this, m_sigs_stats_port_paused[i], stats_name,
+        getProperties()->get("statisticTemplate", "port_paused"));
+    sprintf(signal_name, "stats_port_hol_blocked%d", i);
+    sprintf(stats_name, "port_hol_blocked%d", i);
+    m_sigs_stats_port_hol_blocked[i] = registerSignal(signal_name);
+    getEnvir()->addResultRecorders(
+        this, m_sigs_stats_port_hol_blocked[i], stats_name,
+        getProperties()->get("statisticTemplate", "port_hol_blocked"));
+  }
+
+  // initialize flow control state of the ports connected to nodes
+  m_fc_ports.resize(m_n_ports_nodes);
+  for (uint8_t i = 0; i < m_n_ports_nodes; i++) {
+    fc_port_t &fc_port = m_fc_ports[i];
+    fc_port.paused = false;
+    fc_port.credits = 0;
+    fc_port.hol_blocked = false;
+    fc_port.n_pkts_buffered = 0;
+    fc_port.n_credits_pending = 0;
+    fc_port.node_paused = false;
+
+    if (m_fc_mode == FlowControl::FC_CREDIT) {
+      // grant the node one credit per buffer slot
+      fc_send_to_node(i, false, par("fc_credits").intValue());
+    }
+  }
 }
 
 void TorSwitch::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("TorSwitch");
+
   // is this a self-message?
   if (msg->isSelfMessage()) {
     // yes! this indicates that a packet has been completed transmitted on the
@@ -57,9 +149,13 @@ void TorSwitch::handleMessage(cMessage *msg)
     uint8_t port_id = msg->getKind();
 
     // are there more packets waiting to be sent from buffer?
-    if (!m_queues[port_id].isEmpty()) {
-      send_packet_from_buffer_to_node(port_id);
-    }
+    try_send_packet_to_node(port_id);
+  } else if (msg->getKind() == MSG_KIND_FLOW_CONTROL) {
+    // flow control message sent by a node
+    handle_flow_control(msg);
+  } else if (msg->getKind() == MSG_KIND_IN_FLIGHT_RELEASE) {
+    // release of packets dropped on a node
+    route_in_flight_release((InFlightReleaseMsg *)msg);
   } else {
     // packet arriving
     handle_packet((Packet *)msg);
@@ -90,7 +186,9 @@ void TorSwitch::handle_packet(Packet *pkt)
       ASSERT(pkt->get_hop_cnt() <= m_n_ports_nodes);
 
       // processing of packet has been completed. send it to sink with same port
-      // id as the node arrival port
+      // id as the node arrival port. the packet is not buffered, so the credit
+      // it consumed is returned right away
+      fc_release_credits(arrival_port_id, 1);
       send_packet_to_sink(pkt, arrival_port_id);
     } else {
       // packet may not have completed one ring yet
@@ -98,7 +196,12 @@ void TorSwitch::handle_packet(Packet *pkt)
 
       // packet has not been processed yet, forward to next node
       uint8_t output_port_id;
-      if (pkt->get_flow()->get_toeplitz_hash() % 2 == 0) {
+      if (pkt->has_offload_target()) {
+        // the offloading node selected the target node itself. node ids match
+        // the ids of the ports the nodes are connected to
+        output_port_id = pkt->get_offload_target();
+        pkt->clear_offload_target();
+      } else if (pkt->get_flow().get_toeplitz_hash() % 2 == 0) {
         // forward "right"
         output_port_id = (arrival_port_id + 1) % m_n_ports_nodes;
       } else {
@@ -119,12 +222,27 @@ void TorSwitch::send_packet_to_node(cPacket *pkt, uint8_t port_id)
 {
   ASSERT(port_id < m_n_ports_nodes);
 
-  // place packet in output buffer
-  m_queues[port_id].insert(pkt);
+  // with analytical departures, the packet is sent right away with a delay
+  // covering the transmissions ahead of it
+  if (m_analytical_departures) {
+    send_packet_to_node_analytical(pkt, port_id);
+    return;
+  }
 
-  if (!m_self_msgs[port_id].isScheduled()) {
-    send_packet_from_buffer_to_node(port_id);
+  // place packet in output buffer. if the buffer is full, the packet is
+  // dropped
+  if (m_queues[port_id]->insert(pkt) == false) {
+    drop_packet(pkt, port_id);
+    return;
   }
+
+  // account for the buffer occupied by packets received from nodes
+  int arrival_port_id = get_node_arrival_port(pkt);
+  if (arrival_port_id >= 0) {
+    fc_account_pkt(arrival_port_id);
+  }
+
+  try_send_packet_to_node(port_id);
 }
 
 void TorSwitch::send_packet_to_sink(cPacket *pkt, uint8_t port_id)
@@ -132,19 +250,34 @@ void TorSwitch::send_packet_to_sink(cPacket *pkt, uint8_t port_id)
   // number of node ports is equal to number of sink ports
   ASSERT(port_id < m_n_ports_nodes);
 
+  // the packet leaves the offloading paths of the nodes it has traversed
+  release_in_flight((Packet *)pkt);
+
   send(pkt, "sinks", port_id);
 }
 
 void TorSwitch::send_packet_from_buffer_to_node(uint8_t port_id)
 {
   // make sure queue is not empty
-  ASSERT(!m_queues[port_id].isEmpty());
+  ASSERT(!m_queues[port_id]->is_empty());
 
   // make sure channel is not busy
   ASSERT(!m_channels_nodes[port_id]->isBusy());
 
   // get packet from queue
-  cPacket *pkt = m_queues[port_id].pop();
+  cPacket *pkt = m_queues[port_id]->pop();
+
+  // free the buffer the packet occupied if it has been received from a node
+  int arrival_port_id = get_node_arrival_port(pkt);
+  if (arrival_port_id >= 0) {
+    fc_release_pkt(arrival_port_id);
+  }
+
+  // each packet consumes one of the credits granted by the node
+  if (m_fc_mode == FlowControl::FC_CREDIT) {
+    ASSERT(m_fc_ports[port_id].credits > 0);
+    m_fc_ports[port_id].credits--;
+  }
 
   // calculate how long the packet has been waiting in the buffer
   simtime_t t_buffer = simTime() - pkt->getArrivalTime();
@@ -168,11 +301,239 @@ void TorSwitch::send_packet_from_buffer_to_node(uint8_t port_id)
   scheduleAt(t_done, &m_self_msgs[port_id]);
 }
 
+void TorSwitch::send_packet_to_node_analytical(cPacket *pkt, uint8_t port_id)
+{
+  // forget the packets whose transmission has started already. the remaining
+  // ones are still waiting in the buffer
+  std::deque<simtime_t> &t_departures = m_t_departures[port_id];
+  while (!t_departures.empty() && (t_departures.front() <= simTime())) {
+    t_departures.pop_front();
+  }
+
+  // if the buffer is full, the packet is dropped
+  if ((m_queue_capacity > 0) && (t_departures.size() >= m_queue_capacity)) {
+    drop_packet(pkt, port_id);
+    return;
+  }
+
+  // the packet's transmission starts as soon as the packets ahead of it have
+  // been transmitted
+  simtime_t t_start = simTime();
+  if (m_t_link_free[port_id] > t_start) {
+    t_start = m_t_link_free[port_id];
+  }
+  m_t_link_free[port_id] =
+      t_start + m_channels_nodes[port_id]->calculateDuration(pkt);
+  t_departures.push_back(t_start);
+
+  // add latency element for the time the packet will spend in the buffer
+  simtime_t t_buffer = t_start - simTime();
+  Latency *latency = ((Packet *)pkt)->get_latency();
+  latency->add_element(new LatencyElement(LatencyElement::TOR, t_buffer));
+
+  // send packet once its transmission starts
+  sendDelayed(pkt, t_buffer, "nodes$o", port_id);
+}
+
 uint8_t TorSwitch::select_output_port(Packet *pkt)
 {
   // get crc32 hash
-  uint32_t hash = pkt->get_flow()->get_crc32_hash();
+  uint32_t hash = pkt->get_flow().get_crc32_hash();
 
   // calculate and return output port
   return hash % m_n_ports_nodes;
-}
\ No newline at end of file
+}
+
+void TorSwitch::drop_packet(cPacket *pkt, uint8_t port_id)
+{
+  // report traffic class of the dropped packet
+  emit(m_sig_stats_drop_class, m_queues[port_id]->get_traffic_class(pkt));
+
+  // packet leaves the offloading paths of the nodes it has traversed
+  release_in_flight((Packet *)pkt);
+
+  // return the credit of a packet received from a node
+  int arrival_port_id = get_node_arrival_port(pkt);
+  if (arrival_port_id >= 0) {
+    fc_release_credits(arrival_port_id, 1);
+  }
+
+  delete pkt;
+}
+
+void TorSwitch::release_in_flight(Packet *pkt)
+{
+  if (pkt->has_in_flight_refs()) {
+    route_in_flight_release(pkt->create_in_flight_release());
+  }
+}
+
+void TorSwitch::route_in_flight_release(InFlightReleaseMsg *msg)
+{
+  ASSERT(msg->getNodeIdsArraySize() == msg->getEntryIdsArraySize());
+
+  // the counters are owned by the offload modules of the nodes. send each node
+  // the releases of its own counters on its control link. node ids match the
+  // ids of the ports the nodes are connected to
+  std::map<uint8_t, InFlightReleaseMsg *> node_msgs;
+  for (size_t i = 0; i < msg->getNodeIdsArraySize(); i++) {
+    uint8_t node_id = msg->getNodeIds(i);
+    ASSERT(node_id < gateSize("fc$o"));
+
+    InFlightReleaseMsg *&node_msg = node_msgs[node_id];
+    if (node_msg == NULL) {
+      node_msg = new InFlightReleaseMsg;
+      node_msg->setKind(MSG_KIND_IN_FLIGHT_RELEASE);
+    }
+    size_t n = node_msg->getEntryIdsArraySize();
+    node_msg->setNodeIdsArraySize(n + 1);
+    node_msg->setEntryIdsArraySize(n + 1);
+    node_msg->setNodeIds(n, node_id);
+    node_msg->setEntryIds(n, msg->getEntryIds(i));
+  }
+
+  std::map<uint8_t, InFlightReleaseMsg *>::iterator it;
+  for (it = node_msgs.begin(); it != node_msgs.end(); it++) {
+    send(it->second, "fc$o", it->first);
+  }
+
+  delete msg;
+}
+
+void TorSwitch::handle_flow_control(cMessage *msg)
+{
+  // the control link the message arrived on matches the node's port
+  FlowControlMsg *fc_msg = (FlowControlMsg *)msg;
+  uint8_t port_id = msg->getArrivalGate()->getIndex();
+  ASSERT(port_id < m_n_ports_nodes);
+  ASSERT(m_fc_mode != FlowControl::FC_NONE);
+
+  fc_port_t &fc_port = m_fc_ports[port_id];
+  if (m_fc_mode == FlowControl::FC_PFC) {
+    // node pauses/resumes transmission on the port. the pause only takes
+    // effect after the ongoing transmission
+    ASSERT(fc_port.paused != fc_msg->getPause());
+    fc_port.paused = fc_msg->getPause();
+    emit(m_sigs_stats_port_paused[port_id], fc_port.paused);
+  } else {
+    // node has freed buffer space
+    fc_port.credits += fc_msg->getCredits();
+  }
+
+  delete msg;
+
+  try_send_packet_to_node(port_id);
+}
+
+void TorSwitch::try_send_packet_to_node(uint8_t port_id)
+{
+  // start transmission if the link is idle and flow control allows sending
+  if (!m_self_msgs[port_id].isScheduled() && !m_queues[port_id]->is_empty() &&
+      can_send_packet_to_node(port_id)) {
+    send_packet_from_buffer_to_node(port_id);
+  }
+  update_hol_blocking(port_id);
+}
+
+bool TorSwitch::can_send_packet_to_node(uint8_t port_id)
+{
+  // does flow control allow to send another packet to the node?
+  if (m_fc_mode == FlowControl::FC_PFC) {
+    return !m_fc_ports[port_id].paused;
+  } else if (m_fc_mode == FlowControl::FC_CREDIT) {
+    return m_fc_ports[port_id].credits > 0;
+  }
+  return true;
+}
+
+int TorSwitch::get_node_arrival_port(cPacket *pkt)
+{
+  // return the id of the port the packet has been received on, if it has been
+  // received from a node
+  cGate *arrival_gate = pkt->getArrivalGate();
+  if (strcmp(arrival_gate->getName(), "nodes$i") == 0) {
+    return arrival_gate->getIndex();
+  }
+  return -1;
+}
+
+void TorSwitch::fc_account_pkt(uint8_t port_id)
+{
+  fc_port_t &fc_port = m_fc_ports[port_id];
+  fc_port.n_pkts_buffered++;
+
+  // pause the node if too many of its packets are buffered
+  if ((m_fc_mode == FlowControl::FC_PFC) && !fc_port.node_paused &&
+      (fc_port.n_pkts_buffered > m_fc_xoff)) {
+    fc_port.node_paused = true;
+    fc_send_to_node(port_id, true, 0);
+  }
+}
+
+void TorSwitch::fc_release_pkt(uint8_t port_id)
+{
+  fc_port_t &fc_port = m_fc_ports[port_id];
+  ASSERT(fc_port.n_pkts_buffered > 0);
+  fc_port.n_pkts_buffered--;
+
+  // resume the node once its packets have drained
+  if ((m_fc_mode == FlowControl::FC_PFC) && fc_port.node_paused &&
+      (fc_port.n_pkts_buffered <= m_fc_xon)) {
+    fc_port.node_paused = false;
+    fc_send_to_node(port_id, false, 0);
+  }
+
+  fc_release_credits(port_id, 1);
+}
+
+void TorSwitch::fc_release_credits(uint8_t port_id, uint32_t n_credits)
+{
+  if (m_fc_mode != FlowControl::FC_CREDIT) {
+    return;
+  }
+
+  // credits are returned in batches to limit the number of messages
+  fc_port_t &fc_port = m_fc_ports[port_id];
+  fc_port.n_credits_pending += n_credits;
+  if (fc_port.n_credits_pending >= m_fc_credit_batch) {
+    fc_send_to_node(port_id, false, fc_port.n_credits_pending);
+    fc_port.n_credits_pending = 0;
+  }
+}
+
+void TorSwitch::fc_send_to_node(uint8_t port_id, bool pause, uint32_t n_credits)
+{
+  // count pause frames
+  if (pause) {
+    emit(m_sig_stats_n_pause_sent, 1);
+  }
+
+  // flow control messages are not queued behind data packets, but are sent
+  // to the node on a separate control link
+  FlowControlMsg *msg = new FlowControlMsg;
+  msg->setKind(MSG_KIND_FLOW_CONTROL);
+  msg->setPause(pause);
+  msg->setCredits(n_credits);
+  send(msg, "fc$o", port_id);
+}
+
+void TorSwitch::update_hol_blocking(uint8_t port_id)
+{
+  // the port is head-of-line blocked if packets are waiting while the link is
+  // idle. this only happens when flow control holds back transmission
+  fc_port_t &fc_port = m_fc_ports[port_id];
+  bool hol_blocked =
+      !m_self_msgs[port_id].isScheduled() && !m_queues[port_id]->is_empty();
+  if (hol_blocked == fc_port.hol_blocked) {
+    return;
+  }
+
+  fc_port.hol_blocked = hol_blocked;
+  emit(m_sigs_stats_port_hol_blocked[port_id], hol_blocked);
+  if (hol_blocked) {
+    fc_port.t_hol_blocked_start = simTime();
+  } else {
+    emit(m_sig_stats_hol_blocking_time,
+         simTime() - fc_port.t_hol_blocked_start);
+  }
+}
@@ -1,11 +1,16 @@
 #ifndef MODULES_TORSWITCH_H_
 #define MODULES_TORSWITCH_H_
 
+#include <deque>
 #include <omnetpp.h>
 
+#include "node/FlowControl.h"
+
 using namespace omnetpp;
 
+class InFlightReleaseMsg;
 class Packet;
+class PacketScheduler;
 
 class TorSwitch : public cSimpleModule
 {
@@ -19,15 +24,56 @@ protected:
   uint8_t m_n_ports_nodes;
 
 private:
+  typedef struct {
+    bool paused;      // pfc: transmission to the node paused by the node
+    int32_t credits;  // credit: packets the node can still accept
+    bool hol_blocked; // packets waiting while flow control holds back the link
+    simtime_t t_hol_blocked_start;
+    uint32_t n_pkts_buffered;   // packets received from the node still queued
+    uint32_t n_credits_pending; // credits not yet returned to the node
+    bool node_paused;           // pfc: node paused by the switch
+  } fc_port_t;
+
   void handle_packet(Packet *pkt);
+  void handle_flow_control(cMessage *msg);
   void send_packet_to_node(cPacket *pkt, uint8_t port_id);
   void send_packet_to_sink(cPacket *pkt, uint8_t port_id);
   void send_packet_from_buffer_to_node(uint8_t port_id);
+  void send_packet_to_node_analytical(cPacket *pkt, uint8_t port_id);
   uint8_t select_output_port(Packet *pkt);
+  void drop_packet(cPacket *pkt, uint8_t port_id);
+  void release_in_flight(Packet *pkt);
+  void route_in_flight_release(InFlightReleaseMsg *msg);
+  void try_send_packet_to_node(uint8_t port_id);
+  bool can_send_packet_to_node(uint8_t port_id);
+  int get_node_arrival_port(cPacket *pkt);
+  void fc_account_pkt(uint8_t port_id);
+  void fc_release_pkt(uint8_t port_id);
+  void fc_release_credits(uint8_t port_id, uint32_t n_credits);
+  void fc_send_to_node(uint8_t port_id, bool pause, uint32_t n_credits);
+  void update_hol_blocking(uint8_t port_id);
 
-  cPacketQueue *m_queues;
+  PacketScheduler **m_queues;
   cChannel **m_channels_nodes;
   cMessage *m_self_msgs;
+
+  bool m_analytical_departures;
+  uint32_t m_queue_capacity;
+  std::vector<simtime_t> m_t_link_free; // time the last transmission finishes
+  // transmission start of the packets buffered per port
+  std::vector<std::deque<simtime_t> > m_t_departures;
+
+  FlowControl::fc_mode_t m_fc_mode;
+  uint32_t m_fc_xoff;
+  uint32_t m_fc_xon;
+  uint32_t m_fc_credit_batch;
+  std::vector<fc_port_t> m_fc_ports;
+
+  simsignal_t m_sig_stats_drop_class;
+  simsignal_t m_sig_stats_n_pause_sent;
+  simsignal_t m_sig_stats_hol_blocking_time;
+  simsignal_t *m_sigs_stats_port_paused;
+  simsignal_t *m_sigs_stats_port_hol_blocked;
 };
 
 #endif
@@ -0,0 +1,235 @@
+#include "TraceCache.h"
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+std::map<std::string, TraceCache::trace_t> TraceCache::s_traces;
+std::map<std::string, TraceCache::ipp_t> TraceCache::s_ipps;
+
+TraceReader::TraceReader(const char *filename_pcap,
+                         const char *filename_pcap_ts,
+                         const char *filename_crc32,
+                         const char *filename_toeplitz,
+                         const char *filename_ids)
+    : m_filename_pcap(filename_pcap), m_filename_pcap_ts(filename_pcap_ts),
+      m_filename_crc32(filename_crc32), m_filename_toeplitz(filename_toeplitz),
+      m_filename_ids(filename_ids)
+{
+  m_pcap_descr = NULL;
+  open();
+}
+
+TraceReader::~TraceReader() { close(); }
+
+void TraceReader::open()
+{
+  // open pcap file
+  char pcap_errbuf[PCAP_ERRBUF_SIZE];
+  m_pcap_descr = pcap_open_offline(m_filename_pcap.c_str(), pcap_errbuf);
+  if (m_pcap_descr == NULL) {
+    throw cRuntimeError("could not open pcap file");
+  }
+
+  // open timestamp file
+  m_file_pcap_ts.open(m_filename_pcap_ts.c_str());
+  if (m_file_pcap_ts.is_open() == false) {
+    throw cRuntimeError("could not open pcap timestamp file");
+  }
+
+  // open file containing crc32 hashes
+  m_file_crc32.open(m_filename_crc32.c_str());
+  if (m_file_crc32.is_open() == false) {
+    throw cRuntimeError("could not open crc32 hash file");
+  }
+
+  // open file containing toeplitz hashes
+  m_file_toeplitz.open(m_filename_toeplitz.c_str());
+  if (m_file_toeplitz.is_open() == false) {
+    throw cRuntimeError("could not toeplitz hash file");
+  }
+
+  // open file containing flow and packet ids
+  m_file_ids.open(m_filename_ids.c_str());
+  if (m_file_ids.is_open() == false) {
+    throw cRuntimeError("could not open id file");
+  }
+
+  // the first timestamp determines the time offset of all packets
+  m_first = true;
+}
+
+void TraceReader::close()
+{
+  if (m_pcap_descr) {
+    pcap_close(m_pcap_descr);
+    m_pcap_descr = NULL;
+  }
+  m_file_pcap_ts.close();
+  m_file_crc32.close();
+  m_file_toeplitz.close();
+  m_file_ids.close();
+}
+
+void TraceReader::rewind()
+{
+  close();
+  open();
+}
+
+bool TraceReader::next(trace_pkt_t *pkt)
+{
+  pcap_pkthdr *pkt_hdr;
+  const uint8_t *data;
+
+  // get the next packet from pcap file
+  int32_t ret = pcap_next_ex(m_pcap_descr, &pkt_hdr, &data);
+  if (ret == 1) {
+    // all good
+  } else if (ret == -2) {
+    // no more packets
+    return false;
+  } else {
+    throw cRuntimeError("could not read from pcap file");
+  }
+
+  pkt->len = pkt_hdr->len;
+  decode_ip(data, pkt_hdr->caplen, pkt);
+
+  // get the next timestamp
+  std::string file_pcap_ts_line;
+  std::getline(m_file_pcap_ts, file_pcap_ts_line);
+
+  // find the decimal point
+  pkt->t = 0;
+  for (size_t i = 0; i < file_pcap_ts_line.length(); i++) {
+    if (file_pcap_ts_line[i] == '.') {
+      // found it!
+      if (m_first) {
+        m_pcap_offset_sec = atol(file_pcap_ts_line.substr(0, i).c_str());
+      } else {
+        pkt->t =
+            atol(file_pcap_ts_line.substr(0, i).c_str()) - m_pcap_offset_sec;
+      }
+      pkt->t +=
+          atof((std::string("0.") + file_pcap_ts_line.substr(i + 1)).c_str());
+      break;
+    }
+  }
+  m_first = false;
+
+  // get next packet/flow id line from file
+  std::string ids_str;
+  std::getline(m_file_ids, ids_str);
+  const char *ids = ids_str.c_str();
+
+  // separate flow and packet ids (':' seperated)
+  char *p = strchr((char *)ids, ':');
+  ASSERT(p);
+  *p = 0;
+
+  // get flow and packet ids
+  pkt->flow_id = atol(ids);
+  pkt->pkt_id = atol(p + 1);
+
+  // get toeplitz hash value from file
+  std::string toeplitz_hash_str;
+  std::getline(m_file_toeplitz, toeplitz_hash_str);
+  pkt->toeplitz_hash = atol(toeplitz_hash_str.c_str());
+
+  // get crc32 hash value from file
+  std::string crc32_hash_str;
+  std::getline(m_file_crc32, crc32_hash_str);
+  pkt->crc32_hash = atol(crc32_hash_str.c_str());
+
+  return true;
+}
+
+void TraceReader::decode_ip(const uint8_t *data, uint32_t caplen,
+                            trace_pkt_t *pkt)
+{
+  // traces contain raw ip packets (no link layer header). non-ip packets
+  // (or ones whose ip header has not been captured) are only rejected by the
+  // generator if it needs the payload length or dscp
+  pkt->ip = false;
+  pkt->payload_len = 0;
+  pkt->dscp = 0;
+  if (caplen < 1) {
+    return;
+  }
+
+  if (((data[0] >> 4) == 4) && (caplen >= sizeof(struct ip))) {
+    // ipv4. payload is everything following the ip header
+    const struct ip *hdr = (const struct ip *)data;
+    pkt->payload_len = ntohs(hdr->ip_len) - hdr->ip_hl * 4;
+    pkt->dscp = data[1] >> 2;
+    pkt->ip = true;
+  } else if (((data[0] >> 4) == 6) && (caplen >= sizeof(struct ip6_hdr))) {
+    // ipv6
+    const struct ip6_hdr *hdr = (const struct ip6_hdr *)data;
+    pkt->payload_len = ntohs(hdr->ip6_plen);
+    pkt->dscp = (((data[0] & 0x0f) << 4) | (data[1] >> 4)) >> 2;
+    pkt->ip = true;
+  }
+}
+
+const TraceCache::trace_t *TraceCache::get_trace(const char *filename_pcap,
+                                                 const char *filename_pcap_ts,
+                                                 const char *filename_crc32,
+                                                 const char *filename_toeplitz,
+                                                 const char *filename_ids)
+{
+  // already loaded?
+  const trace_t *trace = find_trace(filename_pcap);
+  if (trace) {
+    return trace;
+  }
+
+  // decode the whole trace
+  TraceReader reader(filename_pcap, filename_pcap_ts, filename_crc32,
+                     filename_toeplitz, filename_ids);
+  trace_t &pkts = s_traces[filename_pcap];
+  trace_pkt_t pkt;
+  while (reader.next(&pkt)) {
+    pkts.push_back(pkt);
+  }
+  pkts.shrink_to_fit();
+
+  return &pkts;
+}
+
+const TraceCache::trace_t *TraceCache::find_trace(const char *filename_pcap)
+{
+  std::map<std::string, trace_t>::const_iterator it =
+      s_traces.find(filename_pcap);
+  return (it != s_traces.end()) ? &it->second : NULL;
+}
+
+const TraceCache::ipp_t *TraceCache::get_ipp(const char *filename_ipp)
+{
+  // already loaded?
+  const ipp_t *ipp = find_ipp(filename_ipp);
+  if (ipp) {
+    return ipp;
+  }
+
+  std::ifstream file(filename_ipp);
+  if (file.is_open() == false) {
+    throw cRuntimeError("could not open ipp file");
+  }
+
+  // one ipp value per line
+  ipp_t &values = s_ipps[filename_ipp];
+  std::string instr_str;
+  while (std::getline(file, instr_str)) {
+    values.push_back(atol(instr_str.c_str()));
+  }
+  values.shrink_to_fit();
+
+  return &values;
+}
+
+const TraceCache::ipp_t *TraceCache::find_ipp(const char *filename_ipp)
+{
+  std::map<std::string, ipp_t>::const_iterator it = s_ipps.find(filename_ipp);
+  return (it != s_ipps.end()) ? &it->second : NULL;
+}
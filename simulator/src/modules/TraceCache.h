@@ -0,0 +1,81 @@
+#ifndef MODULES_TRACECACHE_H_
+#define MODULES_TRACECACHE_H_
+
+#include <fstream>
+#include <omnetpp.h>
+#include <pcap.h>
+
+using namespace omnetpp;
+
+// packet of a trace, decoded from the pcap file and the files holding the
+// timestamps, flow/packet ids and hash values of the trace's packets
+typedef struct {
+  simtime_t t;            // time relative to the trace's first second
+  uint32_t len;           // packet length
+  uint32_t payload_len;   // length of the ip payload (ip packets only)
+  uint8_t dscp;           // dscp of the ip header (ip packets only)
+  bool ip;                // ip packet?
+  uint64_t flow_id;       // flow id
+  uint64_t pkt_id;        // packet id within the flow
+  uint32_t toeplitz_hash; // toeplitz hash value of the flow
+  uint32_t crc32_hash;    // crc32 hash value of the flow
+} trace_pkt_t;
+
+// reads a trace packet by packet
+class TraceReader
+{
+public:
+  TraceReader(const char *filename_pcap, const char *filename_pcap_ts,
+              const char *filename_crc32, const char *filename_toeplitz,
+              const char *filename_ids);
+  virtual ~TraceReader();
+
+  bool next(trace_pkt_t *pkt);
+  void rewind();
+
+private:
+  void open();
+  void close();
+  void decode_ip(const uint8_t *data, uint32_t caplen, trace_pkt_t *pkt);
+
+  std::string m_filename_pcap;
+  std::string m_filename_pcap_ts;
+  std::string m_filename_crc32;
+  std::string m_filename_toeplitz;
+  std::string m_filename_ids;
+
+  pcap_t *m_pcap_descr;
+  __time_t m_pcap_offset_sec;
+  bool m_first;
+
+  std::ifstream m_file_pcap_ts;
+  std::ifstream m_file_crc32;
+  std::ifstream m_file_toeplitz;
+  std::ifstream m_file_ids;
+};
+
+// process-wide cache of decoded traces and ipp files. entries are loaded on
+// first use and kept until the process exits, so that all simulation runs
+// executed by the process (or by processes forked from it, see SweepCmdenv)
+// share them instead of parsing the files again
+class TraceCache
+{
+public:
+  typedef std::vector<trace_pkt_t> trace_t;
+  typedef std::vector<uint32_t> ipp_t;
+
+  static const trace_t *get_trace(const char *filename_pcap,
+                                  const char *filename_pcap_ts,
+                                  const char *filename_crc32,
+                                  const char *filename_toeplitz,
+                                  const char *filename_ids);
+  static const trace_t *find_trace(const char *filename_pcap);
+  static const ipp_t *get_ipp(const char *filename_ipp);
+  static const ipp_t *find_ipp(const char *filename_ipp);
+
+private:
+  static std::map<std::string, trace_t> s_traces;
+  static std::map<std::string, ipp_t> s_ipps;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "FlowControl.h"
+#include "../../defines.h"
+#include "../../msgs/FlowControlMsg_m.h"
+#include "../Profiler.h"
+#include "OutputBuffer.h"
+
+Define_Module(FlowControl);
+
+FlowControl::fc_mode_t FlowControl::parse_mode(const char *mode)
+{
+  if (strcmp(mode, "none") == 0) {
+    return FC_NONE;
+  } else if (strcmp(mode, "pfc") == 0) {
+    return FC_PFC;
+  } else if (strcmp(mode, "credit") == 0) {
+    return FC_CREDIT;
+  }
+  throw cRuntimeError("unknown flow control mode '%s'", mode);
+}
+
+void FlowControl::initialize()
+{
+  // flow control enabled?
+  m_mode = parse_mode(par("mode"));
+
+  m_n_pkts_buffered = 0;
+  m_n_credits_pending = 0;
+  m_tor_paused = false;
+
+  m_sig_stats_n_pause_sent = registerSignal("stats_n_pause_sent");
+
+  if (m_mode == FC_NONE) {
+    // nothing more to do
+    return;
+  }
+
+  // get parameters
+  m_xoff = par("xoff");
+  m_xon = par("xon");
+  m_credit_batch = par("credit_batch");
+  ASSERT(m_xon < m_xoff);
+  ASSERT(m_credit_batch > 0);
+
+  // credits are returned in batches. if a batch is larger than the credits
+  // granted, the switch runs out of credits before any are returned
+  if ((m_mode == FC_CREDIT) && (par("credits").intValue() < m_credit_batch)) {
+    throw cRuntimeError("credits must not be smaller than credit_batch");
+  }
+
+  // get pointer on the output buffer sending to the tor switch
+  m_module_out_buffer = (OutputBuffer *)getModuleByPath("^.out_buffer[0]");
+  ASSERT(m_module_out_buffer);
+
+  if (m_mode == FC_CREDIT) {
+    // grant the switch one credit per buffer slot
+    send_to_tor(false, par("credits").intValue());
+  }
+}
+
+void FlowControl::handleMessage(cMessage *msg)
+{
+  PROFILE_HANDLE_MESSAGE("FlowControl");
+
+  if (msg->getKind() == MSG_KIND_IN_FLIGHT_RELEASE) {
+    // releases of packets dropped on this node go to the tor switch, which
+    // routes them to the nodes owning the counters. releases arriving from
+    // the switch are for this node's offload module
+    if (msg->getArrivalGate() == gate("fc$i")) {
+      send(msg, "release_out");
+    } else {
+      send(msg, "fc$o");
+    }
+    return;
+  }
+
+  // the tor switch signals congestion of its buffers holding packets sent by
+  // this node. pass it on to the output buffer transmitting them
+  ASSERT(msg->getKind() == MSG_KIND_FLOW_CONTROL);
+  ASSERT(m_mode != FC_NONE);
+  FlowControlMsg *fc_msg = (FlowControlMsg *)msg;
+
+  if (m_mode == FC_PFC) {
+    m_module_out_buffer->set_paused(fc_msg->getPause());
+  } else {
+    m_module_out_buffer->add_credits(fc_msg->getCredits());
+  }
+
+  delete msg;
+}
+
+void FlowControl::report_pkt_enqueued()
+{
+  Enter_Method_Silent();
+
+  if (m_mode == FC_NONE) {
+    return;
+  }
+
+  // packet received from the switch has been placed in an rx queue
+  m_n_pkts_buffered++;
+
+  // pause the switch port if too many packets are waiting
+  if ((m_mode == FC_PFC) && !m_tor_paused &&
+      (m_n_pkts_buffered > m_xoff)) {
+    m_tor_paused = true;
+    send_to_tor(true, 0);
+  }
+}
+
+void FlowControl::report_pkt_dequeued()
+{
+  Enter_Method_Silent();
+
+  if (m_mode == FC_NONE) {
+    return;
+  }
+
+  // packet has left the rx queues, either because its processing started or
+  // because it has been dropped
+  ASSERT(m_n_pkts_buffered > 0);
+  m_n_pkts_buffered--;
+
+  if (m_mode == FC_PFC) {
+    // resume the switch port once the queues have drained
+    if (m_tor_paused && (m_n_pkts_buffered <= m_xon)) {
+      m_tor_paused = false;
+      send_to_tor(false, 0);
+    }
+  } else {
+    // the buffer slot is free again
+    release_credits(1);
+  }
+}
+
+void FlowControl::report_pkt_forwarded()
+{
+  Enter_Method_Silent();
+
+  // packet received from the switch has been offloaded without being queued.
+  // its buffer slot is free right away
+  if (m_mode == FC_CREDIT) {
+    release_credits(1);
+  }
+}
+
+void FlowControl::release_credits(uint32_t n_credits)
+{
+  // credits are returned in batches to limit the number of messages
+  m_n_credits_pending += n_credits;
+  if (m_n_credits_pending >= m_credit_batch) {
+    send_to_tor(false, m_n_credits_pending);
+    m_n_credits_pending = 0;
+  }
+}
+
+void FlowControl::send_to_tor(bool pause, uint32_t n_credits)
+{
+  // count pause frames
+  if (pause) {
+    emit(m_sig_stats_n_pause_sent, 1);
+  }
+
+  // flow control messages are not queued behind data packets, but are sent
+  // to the switch on a separate control link
+  FlowControlMsg *msg = new FlowControlMsg;
+  msg->setKind(MSG_KIND_FLOW_CONTROL);
+  msg->setPause(pause);
+  msg->setCredits(n_credits);
+  send(msg, "fc$o");
+}
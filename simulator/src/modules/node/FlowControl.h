@@ -0,0 +1,43 @@
+#ifndef MODULES_NODE_FLOWCONTROL_H_
+#define MODULES_NODE_FLOWCONTROL_H_
+
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+class OutputBuffer;
+
+class FlowControl : public cSimpleModule
+{
+public:
+  typedef enum { FC_NONE, FC_PFC, FC_CREDIT } fc_mode_t;
+
+  static fc_mode_t parse_mode(const char *mode);
+
+  void report_pkt_enqueued();
+  void report_pkt_dequeued();
+  void report_pkt_forwarded();
+
+protected:
+  virtual void initialize();
+  virtual void handleMessage(cMessage *msg);
+
+private:
+  void release_credits(uint32_t n_credits);
+  void send_to_tor(bool pause, uint32_t n_credits);
+
+  fc_mode_t m_mode;
+  uint32_t m_xoff;
+  uint32_t m_xon;
+  uint32_t m_credit_batch;
+
+  uint32_t m_n_pkts_buffered;
+  uint32_t m_n_credits_pending;
+  bool m_tor_paused;
+
+  OutputBuffer *m_module_out_buffer;
+
+  simsignal_t m_sig_stats_n_pause_sent;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "HeavyHitterSketch.h"
+
+HeavyHitterSketch::HeavyHitterSketch(uint32_t size, uint32_t top_k)
+{
+  ASSERT(size > 0);
+  ASSERT(top_k > 0);
+  ASSERT(top_k <= size);
+
+  m_size = size;
+  m_top_k = top_k;
+
+  // initially all counter slots are unused
+  m_n_slots_used = 0;
+  m_counters = new counter_t[m_size];
+  for (uint32_t i = 0; i < m_size; i++) {
+    m_counters[i].flow_key = 0;
+    m_counters[i].count = 0.0;
+    m_counters[i].error = 0.0;
+    m_counters[i].top = false;
+  }
+}
+
+HeavyHitterSketch::~HeavyHitterSketch()
+{
+  delete[] m_counters;
+  m_slots.clear();
+  m_counts.clear();
+  m_top.clear();
+}
+
+uint32_t HeavyHitterSketch::update(uint64_t flow_key, double weight,
+                                   bool *slot_reassigned)
+{
+  // is the flow already being tracked?
+  std::map<uint64_t, uint32_t>::const_iterator it = m_slots.find(flow_key);
+  if (it != m_slots.end()) {
+    // yes! just increment its counter
+    add_count(it->second, weight);
+    *slot_reassigned = false;
+    return it->second;
+  }
+
+  // flow is not tracked yet. it will get a slot assigned
+  *slot_reassigned = true;
+
+  uint32_t slot;
+  if (m_n_slots_used < m_size) {
+    // there still is an unused slot. take it
+    slot = m_n_slots_used;
+    m_n_slots_used++;
+    m_counters[slot].count = 0.0;
+    m_counters[slot].error = 0.0;
+    add_count(slot, weight);
+  } else {
+    // all slots are in use. evict the flow with the smallest count. the new
+    // flow inherits the count as its estimation error
+    slot = find_min_slot();
+    m_slots.erase(m_counters[slot].flow_key);
+    m_counters[slot].error = m_counters[slot].count;
+    add_count(slot, weight);
+  }
+
+  // save flow in slot
+  m_counters[slot].flow_key = flow_key;
+  m_slots.insert(std::pair<uint64_t, uint32_t>(flow_key, slot));
+
+  return slot;
+}
+
+bool HeavyHitterSketch::is_top_k(uint32_t slot)
+{
+  ASSERT(slot < m_n_slots_used);
+
+  // the flow is among the top-k heavy hitters if less than k flows are ranked
+  // higher. slots outside the top-k set never count more than the smallest
+  // slot in the set (which is full as soon as a slot is left out), so a slot
+  // outside the set only qualifies if it ties with the smallest one
+  if (m_counters[slot].top) {
+    return true;
+  }
+  return m_counters[slot].count >= m_top.begin()->first;
+}
+
+void HeavyHitterSketch::decay(double factor)
+{
+  ASSERT(factor >= 0.0 && factor <= 1.0);
+
+  // age all counters, so that flows that have been heavy in the past but are
+  // not anymore eventually drop out of the top-k
+  for (uint32_t i = 0; i < m_n_slots_used; i++) {
+    m_counters[i].count *= factor;
+    m_counters[i].error *= factor;
+  }
+
+  // all counters are scaled alike, so the order of the slots remains the
+  // same. only their counts in the sets have to be updated
+  std::set<std::pair<double, uint32_t>> counts;
+  std::set<std::pair<double, uint32_t>>::const_iterator it;
+  for (it = m_counts.begin(); it != m_counts.end(); it++) {
+    counts.insert(std::make_pair(m_counters[it->second].count, it->second));
+  }
+  m_counts.swap(counts);
+  std::set<std::pair<double, uint32_t>> top;
+  for (it = m_top.begin(); it != m_top.end(); it++) {
+    top.insert(std::make_pair(m_counters[it->second].count, it->second));
+  }
+  m_top.swap(top);
+}
+
+uint32_t HeavyHitterSketch::get_size() { return m_size; }
+
+void HeavyHitterSketch::add_count(uint32_t slot, double weight)
+{
+  counter_t &counter = m_counters[slot];
+
+  // re-insert the slot into the set of used slots with its new count. a slot
+  // that has just been taken into use is not in the set yet
+  m_counts.erase(std::make_pair(counter.count, slot));
+  m_counts.insert(std::make_pair(counter.count + weight, slot));
+
+  if (counter.top) {
+    // slot is in the top-k set already. counts only grow, so it stays there.
+    // re-insert it with its new count
+    m_top.erase(std::make_pair(counter.count, slot));
+    counter.count += weight;
+    m_top.insert(std::make_pair(counter.count, slot));
+    return;
+  }
+
+  counter.count += weight;
+
+  if (m_top.size() < m_top_k) {
+    // top-k set is not full yet. slot joins it
+    counter.top = true;
+    m_top.insert(std::make_pair(counter.count, slot));
+  } else if (counter.count > m_top.begin()->first) {
+    // slot now outranks the smallest slot in the top-k set. replace it
+    m_counters[m_top.begin()->second].top = false;
+    m_top.erase(m_top.begin());
+    counter.top = true;
+    m_top.insert(std::make_pair(counter.count, slot));
+  }
+}
+
+uint32_t HeavyHitterSketch::find_min_slot()
+{
+  // the used slots are ordered by their counts. among slots with the same
+  // count, the one with the lowest index comes first
+  ASSERT(m_counts.empty() == false);
+  return m_counts.begin()->second;
+}
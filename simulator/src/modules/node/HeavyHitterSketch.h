@@ -0,0 +1,47 @@
+#ifndef MODULES_NODE_HEAVYHITTERSKETCH_H_
+#define MODULES_NODE_HEAVYHITTERSKETCH_H_
+
+#include <map>
+#include <omnetpp.h>
+#include <set>
+
+using namespace omnetpp;
+
+// space-saving sketch that keeps track of the flows causing the highest load.
+// each flow that is currently being tracked occupies one counter slot. when
+// all slots are occupied, the slot with the smallest counter value is handed
+// over to the new flow. the used slots and the slots ranked among the top-k are
+// kept in sets ordered by their counts, so that neither a lookup nor an
+// eviction has to scan all counters.
+class HeavyHitterSketch
+{
+public:
+  HeavyHitterSketch(uint32_t size, uint32_t top_k);
+  virtual ~HeavyHitterSketch();
+
+  uint32_t update(uint64_t flow_key, double weight, bool *slot_reassigned);
+  bool is_top_k(uint32_t slot);
+  void decay(double factor);
+  uint32_t get_size();
+
+private:
+  typedef struct {
+    uint64_t flow_key; // flow tracked in this slot
+    double count;      // estimated (upper bound) weight of the flow
+    double error;      // max. overestimation of the count
+    bool top;          // slot is in the top-k set
+  } counter_t;
+
+  void add_count(uint32_t slot, double weight);
+  uint32_t find_min_slot();
+
+  uint32_t m_size;
+  uint32_t m_top_k;
+  uint32_t m_n_slots_used;
+  counter_t *m_counters;
+  std::map<uint64_t, uint32_t> m_slots;
+  std::set<std::pair<double, uint32_t>> m_counts; // all used slots
+  std::set<std::pair<double, uint32_t>> m_top;    // top-k slots
+};
+
+#endif
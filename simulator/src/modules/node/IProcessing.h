@@ -0,0 +1,18 @@
+#ifndef MODULES_NODE_IPROCESSING_H_
+#define MODULES_NODE_IPROCESSING_H_
+
+#include <omnetpp.h>
+
+// implemented by the modules that can be used as the node's processing module
+// (see IProcessing.ned), so that the other modules of the node can query its
+// state regardless of the processing model
+class IProcessing
+{
+public:
+  virtual ~IProcessing() {}
+
+  // number of packets currently waiting to be processed
+  virtual uint32_t get_total_queue_len() = 0;
+};
+
+#endif
@@ -2,11 +2,26 @@
 #include "../../defines.h"
 #include "../../msgs/Packet.h"
 #include "../../msgs/PacketNodeContext.h"
+#include "../Profiler.h"
+#include "Offload.h"
 
 Define_Module(Ingress);
 
+void Ingress::initialize()
+{
+  // on the fast path, packets are handed over to the offload module by a
+  // direct call instead of a message
+  m_module_offload = NULL;
+  if (par("enable_fast_path").boolValue()) {
+    m_module_offload = (Offload *)getModuleByPath("^.offload");
+    ASSERT(m_module_offload);
+  }
+}
+
 void Ingress::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("Ingress");
+
   // get arrival port id
   int arrival_port_id = msg->getArrivalGate()->getIndex();
 
@@ -19,8 +34,14 @@ void Ingress::handleMessage(cMessage *msg)
 
     // save arrival gate id
     ctx->set_arrival_port_id((uint8_t)arrival_port_id);
+
+    if (m_module_offload) {
+      m_module_offload->receive_pkt(pkt);
+      return;
+    }
   }
 
   // send out packet
+  msg->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
   send(msg, "out", arrival_port_id);
 }
@@ -5,10 +5,16 @@
 
 using namespace omnetpp;
 
+class Offload;
+
 class Ingress : public cSimpleModule
 {
 protected:
+  virtual void initialize();
   virtual void handleMessage(cMessage *msg);
+
+private:
+  Offload *m_module_offload;
 };
 
 #endif
@@ -0,0 +1,246 @@
+#include "NicProcessing.h"
+#include "../../defines.h"
+#include "../../msgs/InFlightReleaseMsg_m.h"
+#include "../../msgs/Packet.h"
+#include "../../msgs/PacketNodeContext.h"
+#include "../../msgs/ProcDoneMsg_m.h"
+#include "../../msgs/QueueLenMsg_m.h"
+#include "../Profiler.h"
+#include "FlowControl.h"
+#include "OffloadTrigger.h"
+
+Define_Module(NicProcessing);
+
+NicProcessing::~NicProcessing()
+{
+  for (uint8_t i = 0; i < m_n_engines; i++) {
+    cancelAndDelete(m_engines[i].msg_proc_done);
+  }
+  delete[] m_queues;
+}
+
+void NicProcessing::initialize()
+{
+  // get the number of processing engines and their capacity
+  // (instructions/seconds)
+  m_n_engines = par("n_engines");
+  ASSERT(m_n_engines > 0);
+  double capacity_per_engine = par("capacity_per_engine");
+
+  // calculate the duration of one instruction
+  m_t_inst = 1.0 / capacity_per_engine;
+
+  // get queue parameters
+  m_queue_capacity = par("queue_capacity");
+  m_queue_id = par("queue_id");
+
+  // get per-action instruction scaling factors
+  m_instr_scaling =
+      cStringTokenizer(par("instr_scaling").stringValue()).asDoubleVector();
+  if (m_instr_scaling.empty()) {
+    throw cRuntimeError("no instruction scaling factor specified");
+  }
+
+  // create processing engines. initially all of them are idle. each engine
+  // serves its own queue, so that the packets of a flow are processed in order
+  // on the same engine
+  m_queues = new cPacketQueue[m_n_engines];
+  m_queue_len = 0;
+  m_engines.resize(m_n_engines);
+  for (uint8_t i = 0; i < m_n_engines; i++) {
+    m_engines[i].busy = false;
+    ProcDoneMsg *msg_proc_done = new ProcDoneMsg();
+    msg_proc_done->setKind(MSG_KIND_PROC_DONE);
+    msg_proc_done->setCoreId(i);
+    m_engines[i].msg_proc_done = msg_proc_done;
+  }
+  m_n_engines_busy = 0;
+
+  // get pointer on flow control module
+  m_module_flow_control = (FlowControl *)getModuleByPath("^.flow_control");
+  ASSERT(m_module_flow_control);
+
+  // get pointer on offload trigger module. the queue length is only reported
+  // to it when it crosses the offload threshold, since the trigger does not
+  // react to any other change. initially the queue is empty
+  m_module_offload_trigger = (OffloadTrigger *)gate("trigger_out")
+                                 ->getPathEndGate()
+                                 ->getOwnerModule();
+  m_queue_overload = false;
+
+  // register signals for stats collection
+  m_sig_stats_nic_ipp = registerSignal("stats_nic_ipp");
+  m_sig_stats_nic_util = registerSignal("stats_nic_util");
+  m_sig_stats_nic_queue_len = registerSignal("stats_nic_queue_len");
+  m_sig_stats_nic_drop = registerSignal("stats_nic_drop");
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_nic_util, 0);
+  }
+}
+
+void NicProcessing::handleMessage(cMessage *msg)
+{
+  PROFILE_HANDLE_MESSAGE("NicProcessing");
+
+  if (msg->isSelfMessage() == false) {
+    // new packet arriving
+    ASSERT(msg->getKind() == MSG_KIND_PACKET_DATA);
+    Packet *pkt = (Packet *)msg;
+
+    // packet has been accepted from the link
+    m_module_flow_control->report_pkt_enqueued();
+
+    // insert packet into the queue of the engine the flow is pinned to. if
+    // the queues are full, the packet is dropped
+    if ((m_queue_capacity > 0) && (m_queue_len >= m_queue_capacity)) {
+      drop_pkt(pkt);
+      return;
+    }
+    uint8_t engine_id = pkt->get_flow().get_toeplitz_hash() % m_n_engines;
+    m_queues[engine_id].insert(pkt);
+    m_queue_len++;
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_nic_queue_len, m_queue_len);
+    }
+
+    // start processing if the engine has been idle
+    if (m_engines[engine_id].busy == false) {
+      set_busy(engine_id, true);
+      process_packet(engine_id);
+    }
+  } else {
+    // this is a self-message signaling that a packet has been completely
+    // processed
+    ASSERT(msg->getKind() == MSG_KIND_PROC_DONE);
+    Packet *pkt = (Packet *)msg->getContextPointer();
+
+    // get the engine the packet has been processed on
+    uint8_t engine_id = ((ProcDoneMsg *)msg)->getCoreId();
+    ASSERT(engine_id < m_n_engines);
+    ASSERT(m_engines[engine_id].msg_proc_done == msg);
+    ASSERT(m_engines[engine_id].busy);
+
+    // packet has left the local processing path. send it out
+    pkt->get_node_ctx()->release_in_flight_cntr();
+    pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(pkt, "out");
+
+    if (m_queues[engine_id].isEmpty() == false) {
+      // more packets are waiting. process the next one
+      process_packet(engine_id);
+    } else {
+      // no more packets waiting. set engine idle
+      set_busy(engine_id, false);
+    }
+  }
+}
+
+void NicProcessing::process_packet(uint8_t engine_id)
+{
+  engine_t &engine = m_engines[engine_id];
+  ASSERT(engine.busy);
+  ASSERT(m_queues[engine_id].isEmpty() == false);
+
+  // report queue length to the offload trigger
+  report_queue_len();
+
+  // pop packet from queue
+  Packet *pkt = (Packet *)m_queues[engine_id].pop();
+  ASSERT(m_queue_len > 0);
+  m_queue_len--;
+  m_module_flow_control->report_pkt_dequeued();
+
+  // calculate the time required to execute the packet's instructions on the
+  // nic
+  uint32_t instr = calc_instr(pkt);
+  simtime_t t_proc = instr * m_t_inst;
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_nic_ipp, instr);
+  }
+
+  // add latency elements for the time the packet has been waiting and the
+  // processing duration
+  Latency *latency = pkt->get_latency();
+  latency->add_element(new LatencyElement(LatencyElement::NODE_BUFFER_IN,
+                                          simTime() - pkt->getArrivalTime()));
+  latency->add_element(new LatencyElement(LatencyElement::NODE_PROC, t_proc));
+
+  // schedule self-message to be sent after processing is completed. pass along
+  // a pointer to the packet as context
+  engine.msg_proc_done->setContextPointer(pkt);
+  scheduleAt(simTime() + t_proc, engine.msg_proc_done);
+
+  // mark packet as being processed
+  pkt->set_processing_done();
+}
+
+void NicProcessing::report_queue_len()
+{
+  // the offload trigger only changes its decision when the queue length
+  // crosses the threshold. skip all other reports
+  bool overload = m_queue_len > m_module_offload_trigger->get_threshold();
+  if (overload == m_queue_overload) {
+    return;
+  }
+  m_queue_overload = overload;
+
+  QueueLenMsg *msg = new QueueLenMsg;
+  msg->setKind(MSG_KIND_QUEUE_LEN);
+  msg->setQueueId(m_queue_id);
+  msg->setQueueLen(m_queue_len);
+  msg->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+  send(msg, "trigger_out");
+}
+
+uint32_t NicProcessing::calc_instr(Packet *pkt)
+{
+  // get the scaling factor of the action executed on the flow's packets.
+  // flows without an action (ipp values read from file) use the first factor
+  uint32_t action_id = 0;
+  if (pkt->get_flow().is_action_id_set()) {
+    action_id = pkt->get_flow().get_action_id();
+  }
+  if (action_id >= m_instr_scaling.size()) {
+    action_id = 0;
+  }
+
+  uint32_t instr =
+      (uint32_t)(pkt->get_instr() * m_instr_scaling[action_id] + 0.5);
+  return (instr > 0) ? instr : 1;
+}
+
+void NicProcessing::set_busy(uint8_t engine_id, bool busy)
+{
+  // save engine busy/idle state
+  m_engines[engine_id].busy = busy;
+
+  // maintain number of currently busy engines
+  if (busy) {
+    m_n_engines_busy++;
+  } else {
+    ASSERT(m_n_engines_busy > 0);
+    m_n_engines_busy--;
+  }
+
+  // emit utilization statistics
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_nic_util, m_n_engines_busy);
+  }
+}
+
+void NicProcessing::drop_pkt(Packet *pkt)
+{
+  emit(m_sig_stats_nic_drop, 1);
+
+  // packet leaves the local and offloading paths. the tor switch routes the
+  // release of offloaded packets to the nodes they have passed
+  pkt->get_node_ctx()->release_in_flight_cntr();
+  if (pkt->has_in_flight_refs()) {
+    send(pkt->create_in_flight_release(), "release_out");
+  }
+
+  // its slot in the queue is free again
+  m_module_flow_control->report_pkt_dequeued();
+
+  delete pkt;
+}
@@ -0,0 +1,55 @@
+#ifndef MODULES_NODE_NICPROCESSING_H_
+#define MODULES_NODE_NICPROCESSING_H_
+
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+class FlowControl;
+class OffloadTrigger;
+class Packet;
+
+class NicProcessing : public cSimpleModule
+{
+public:
+  virtual ~NicProcessing();
+
+protected:
+  virtual void initialize();
+  virtual void handleMessage(cMessage *msg);
+
+private:
+  typedef struct {
+    bool busy; // engine busy?
+    // message scheduled when processing of packet is done
+    cMessage *msg_proc_done;
+  } engine_t;
+
+  void process_packet(uint8_t engine_id);
+  void report_queue_len();
+  uint32_t calc_instr(Packet *pkt);
+  void set_busy(uint8_t engine_id, bool busy);
+  void drop_pkt(Packet *pkt);
+
+  uint8_t m_n_engines;
+  simtime_t m_t_inst;
+  uint32_t m_queue_capacity;
+  uint8_t m_queue_id;
+  std::vector<double> m_instr_scaling;
+
+  cPacketQueue *m_queues; // one queue per engine
+  uint32_t m_queue_len;   // total number of packets waiting
+  std::vector<engine_t> m_engines;
+  uint8_t m_n_engines_busy;
+
+  FlowControl *m_module_flow_control;
+  OffloadTrigger *m_module_offload_trigger;
+  bool m_queue_overload; // queue length last reported above the threshold?
+
+  simsignal_t m_sig_stats_nic_ipp;
+  simsignal_t m_sig_stats_nic_util;
+  simsignal_t m_sig_stats_nic_queue_len;
+  simsignal_t m_sig_stats_nic_drop;
+};
+
+#endif
@@ -1,16 +1,33 @@
 #include "Offload.h"
 #include "../../defines.h"
+#include "../../msgs/InFlightReleaseMsg_m.h"
 #include "../../msgs/OffloadTriggerMsg_m.h"
 #include "../../msgs/Packet.h"
 #include "../../msgs/PacketNodeContext.h"
+#include "../../msgs/RetaUpdateMsg_m.h"
+#include "../Profiler.h"
+#include "FlowControl.h"
+#include "HeavyHitterSketch.h"
+#include "OutputBuffer.h"
+#include "Processing.h"
 
 Define_Module(Offload);
 
 Offload::~Offload()
 {
-  if (m_enabled_balance_cores || m_enabled_offload) {
+  if (m_enabled_balance_cores || m_enabled_offload || m_enabled_nic_offload) {
     delete[] m_hashtable;
     delete[] m_rx_queue_overload;
+
+    if (m_enabled_heavy_hitter) {
+      delete m_hh_sketch;
+      delete[] m_hh_entries;
+    }
+  }
+  if (m_enabled_p2c_offload) {
+    delete[] m_peer_load;
+    delete[] m_peer_load_t_update;
+    delete[] m_peer_load_valid;
   }
   delete[] m_rss_reta;
 }
@@ -20,6 +37,7 @@ void Offload::initialize()
   // what offloading is enabled?
   m_enabled_balance_cores = par("enable_balance_cores");
   m_enabled_offload = par("enable_offload");
+  m_enabled_nic_offload = par("enable_nic_offload");
 
   // get hashtable size
   m_hashtable_size = par("hashtable_size");
@@ -29,6 +47,9 @@ void Offload::initialize()
   m_max_hop_cnt = par("max_hop_cnt");
   ASSERT(m_max_hop_cnt > 0);
 
+  // get number of traffic classes protected from being offloaded
+  m_offload_protected_classes = par("offload_protected_classes");
+
   // number of input and output gates must both be 1 for now
   ASSERT(gateSize("in") == 1);
   ASSERT(gateSize("out") == 1);
@@ -36,6 +57,38 @@ void Offload::initialize()
   // get number of rx queues
   m_n_rx_queues = par("n_rx_queues");
 
+  // get node id and number of nodes the packets may be offloaded to
+  m_node_id = par("node_id");
+  m_n_nodes = par("n_nodes");
+  ASSERT(m_node_id < m_n_nodes);
+
+  // power-of-two-choices offloading based on the peers' load enabled?
+  m_enabled_p2c_offload = par("enable_p2c_offload");
+
+  if (m_enabled_p2c_offload) {
+    // a packet is offloaded to peers it has not visited yet until it reaches
+    // its last hop, so there must be at least as many nodes as hops. visited
+    // nodes are tracked in a 32 bit mask
+    if ((m_n_nodes < m_max_hop_cnt) || (m_n_nodes > 32)) {
+      throw cRuntimeError("p2c offloading requires max_hop_cnt <= n_nodes "
+                          "<= 32");
+    }
+
+    // initially we do not know anything about the load of our peers
+    m_peer_load_decay = par("peer_load_decay");
+    m_peer_load = new uint32_t[m_n_nodes];
+    m_peer_load_t_update = new simtime_t[m_n_nodes];
+    m_peer_load_valid = new bool[m_n_nodes];
+    for (uint8_t i = 0; i < m_n_nodes; i++) {
+      m_peer_load[i] = 0;
+      m_peer_load_t_update[i] = 0;
+      m_peer_load_valid[i] = false;
+    }
+
+    // register signal for stats collection
+    m_sig_stats_p2c_target_load = registerSignal("stats_p2c_target_load");
+  }
+
   // rss reta table has size of offloading hash table
   m_rss_reta_size = m_hashtable_size;
 
@@ -45,7 +98,33 @@ void Offload::initialize()
     m_rss_reta[i] = i % m_n_rx_queues;
   }
 
-  if (!m_enabled_balance_cores && !m_enabled_offload) {
+  // get pointer on flow control module
+  m_module_flow_control = (FlowControl *)getModuleByPath("^.flow_control");
+  ASSERT(m_module_flow_control);
+
+  // on the fast path, packets are handed over to the processing module and the
+  // output buffer by direct calls instead of messages. processing modules that
+  // do not support this still receive messages
+  m_module_proc = NULL;
+  cModule *module_proc = gate("out_proc")->getPathEndGate()->getOwnerModule();
+  if (par("enable_fast_path").boolValue()) {
+    m_module_proc = dynamic_cast<Processing *>(module_proc);
+    for (int i = 0; i < gateSize("out"); i++) {
+      m_modules_out_buffer.push_back(
+          (OutputBuffer *)gate("out", i)->getPathEndGate()->getOwnerModule());
+    }
+  }
+
+  // if the processing module serves its cores' backlogs lazily, the queue
+  // state must be brought up to date before each offloading decision
+  m_module_proc_lazy = NULL;
+  if (module_proc->hasPar("lazy_service") &&
+      module_proc->par("lazy_service").boolValue()) {
+    m_module_proc_lazy = (Processing *)module_proc;
+  }
+
+  if (!m_enabled_balance_cores && !m_enabled_offload &&
+      !m_enabled_nic_offload) {
     // nothing more to do here
     return;
   }
@@ -55,22 +134,97 @@ void Offload::initialize()
   m_hashtable_entry_timeout = par("hashtable_entry_timeout");
   ASSERT(m_hashtable_size > 0);
 
+  // defer migrations until all in-flight packets of an entry have drained?
+  m_enabled_drain_barrier = par("enable_drain_barrier");
+
+  // offloaded packets hold their entries' in-flight counters until they
+  // arrive at the sink. the tor switch returns the releases over the node's
+  // flow control link
+  if (m_enabled_drain_barrier && m_enabled_offload &&
+      !getParentModule()->gate("fc$o")->getNextGate()) {
+    throw cRuntimeError("drain barrier with offloading requires the node's "
+                        "flow control link to the tor switch");
+  }
+
+  // derive per-entry timeouts from the packet inter-arrival gaps? if enabled,
+  // the configured hashtable entry timeout becomes the upper bound
+  m_enabled_adaptive_timeout = par("enable_adaptive_timeout");
+  m_adaptive_timeout_alpha = par("adaptive_timeout_alpha");
+  m_adaptive_timeout_factor = par("adaptive_timeout_factor");
+  m_adaptive_timeout_min = par("adaptive_timeout_min");
+  ASSERT(m_adaptive_timeout_alpha > 0.0 && m_adaptive_timeout_alpha <= 1.0);
+  ASSERT(m_adaptive_timeout_factor > 0.0);
+
   // initialize hash table. initially mark all entries as inactive (i.e. no
   // packet has hit the entry yet)
   m_hashtable = new hashtable_entry_t[m_hashtable_size];
   for (uint32_t i = 0; i < m_hashtable_size; i++) {
     m_hashtable[i].valid = false;
+    m_hashtable[i].n_in_flight = 0;
+    m_hashtable[i].n_in_flight_prev = NULL;
   }
 
-  // initially no cores attached to the rx queues are overloaded
-  m_rx_queue_overload = new bool[m_n_rx_queues];
-  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+  // initially no cores attached to the rx queues are overloaded. if enabled,
+  // the smartnic's queue is reported with the id following the last rx queue
+  uint16_t n_queues = m_n_rx_queues + (m_enabled_nic_offload ? 1 : 0);
+  m_rx_queue_overload = new bool[n_queues];
+  for (uint16_t i = 0; i < n_queues; i++) {
     m_rx_queue_overload[i] = false;
   }
+
+  // heavy-hitter aware offloading enabled?
+  m_enabled_heavy_hitter = par("enable_heavy_hitter");
+
+  if (m_enabled_heavy_hitter) {
+    // create sketch tracking the flows causing the highest load
+    uint32_t sketch_size = par("heavy_hitter_sketch_size");
+    uint32_t top_k = par("heavy_hitter_top_k");
+    if ((top_k == 0) || (top_k > sketch_size)) {
+      throw cRuntimeError("heavy hitter top-k must be within [1, sketch size]");
+    }
+    m_hh_sketch = new HeavyHitterSketch(sketch_size, top_k);
+
+    // each sketch slot has its own hashtable entry, so that heavy hitters can
+    // be steered independently of the other flows sharing their hash bucket
+    m_hh_entries = new hashtable_entry_t[sketch_size];
+    for (uint32_t i = 0; i < sketch_size; i++) {
+      m_hh_entries[i].valid = false;
+      m_hh_entries[i].n_in_flight = 0;
+      m_hh_entries[i].n_in_flight_prev = NULL;
+    }
+
+    // get sketch decay parameters. a decay interval of zero disables decay
+    m_hh_decay_interval = par("heavy_hitter_decay_interval");
+    m_hh_decay_factor = par("heavy_hitter_decay_factor");
+    m_hh_t_next_decay = m_hh_decay_interval;
+
+    // register signal for stats collection
+    m_sig_stats_hh_n_pkts = registerSignal("stats_hh_n_pkts");
+  }
+
+  // register signals for stats collection (hashtable entry migrations)
+  m_sig_stats_n_migrations_drained =
+      registerSignal("stats_n_migrations_drained");
+  m_sig_stats_n_migrations_timeout =
+      registerSignal("stats_n_migrations_timeout");
+  m_sig_stats_entry_timeout = registerSignal("stats_entry_timeout");
+  m_sig_stats_n_offload_protected = registerSignal("stats_n_offload_protected");
+
+  // no packets steered to the smartnic so far
+  m_n_pkts_nic = 0;
+}
+
+void Offload::finish()
+{
+  // record number of packets steered to the smartnic. kept under the name of
+  // the former count statistic
+  recordScalar("n_nic:count", m_n_pkts_nic);
 }
 
 void Offload::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("Offload");
+
   // get message kind
   uint16_t msgKind = msg->getKind();
 
@@ -80,11 +234,37 @@ void Offload::handleMessage(cMessage *msg)
   } else if (msgKind == MSG_KIND_OFFLOAD_TRIGGER) {
     // this is an offload trigger message
     handle_offload_trigger((OffloadTriggerMsg *)msg);
+  } else if (msgKind == MSG_KIND_RETA_UPDATE) {
+    // the processing module has updated its rss reta
+    handle_reta_update((RetaUpdateMsg *)msg);
+  } else if (msgKind == MSG_KIND_IN_FLIGHT_RELEASE) {
+    // offloaded packets have arrived at the sink or have been dropped
+    handle_in_flight_release((InFlightReleaseMsg *)msg);
   } else {
     ASSERT(false && "invalid message kind");
   }
 }
 
+void Offload::handleParameterChange(const char *name)
+{
+  // hashtable timeouts may be changed during the simulation (e.g. by variants
+  // warm-started from a checkpoint). they apply to the entries' next packets
+  if (strcmp(name, "hashtable_entry_timeout") == 0) {
+    m_hashtable_entry_timeout = par("hashtable_entry_timeout");
+  } else if (strcmp(name, "adaptive_timeout_alpha") == 0) {
+    m_adaptive_timeout_alpha = par("adaptive_timeout_alpha");
+    ASSERT(m_adaptive_timeout_alpha > 0.0 && m_adaptive_timeout_alpha <= 1.0);
+  } else if (strcmp(name, "adaptive_timeout_factor") == 0) {
+    m_adaptive_timeout_factor = par("adaptive_timeout_factor");
+    ASSERT(m_adaptive_timeout_factor > 0.0);
+  } else if (strcmp(name, "adaptive_timeout_min") == 0) {
+    m_adaptive_timeout_min = par("adaptive_timeout_min");
+  } else {
+    throw cRuntimeError("parameter '%s' cannot be changed during simulation",
+                        name);
+  }
+}
+
 void Offload::handle_pkt(Packet *pkt)
 {
   if (m_enabled_offload) {
@@ -98,7 +278,23 @@ void Offload::handle_pkt(Packet *pkt)
     ASSERT(pkt->get_hop_cnt() == 0);
   }
 
-  if (!m_enabled_balance_cores && !m_enabled_offload) {
+  // catch up on the queue state changes of lazily served packets, which may
+  // update the overload state of the rx queues
+  if (m_module_proc_lazy) {
+    m_module_proc_lazy->sync_backlogs();
+  }
+
+  if (m_enabled_p2c_offload) {
+    // the packet must not be offloaded back to this node. in case the packet
+    // has been offloaded by another node, learn about that node's load
+    pkt->mark_visited(m_node_id);
+    if (pkt->has_load_stamp()) {
+      update_peer_load(pkt);
+    }
+  }
+
+  if (!m_enabled_balance_cores && !m_enabled_offload &&
+      !m_enabled_nic_offload) {
     // no offload functionality is enabled. determine target rx queue based on
     // rss reta and send packet to local node. nothing more to do!
     uint8_t rx_queue = calc_rss_rx_queue(pkt);
@@ -106,11 +302,10 @@ void Offload::handle_pkt(Packet *pkt)
     return;
   }
 
-  // get toeplitz hash
-  uint32_t toeplitz_hash = pkt->get_flow()->get_toeplitz_hash();
-
-  // lookup hashtable entry
-  hashtable_entry_t &ht_entry = m_hashtable[toeplitz_hash % m_hashtable_size];
+  // lookup hashtable entry. determines whether packets hitting the entry may
+  // be moved to another core or be offloaded
+  bool allow_migration;
+  hashtable_entry_t &ht_entry = lookup_hashtable_entry(pkt, &allow_migration);
 
   // determine the target rx queue for the case that the arriving packet shall
   // be processed locally.
@@ -125,7 +320,7 @@ void Offload::handle_pkt(Packet *pkt)
     }
 
     // is the currently assigned core overloaded?
-    if (m_rx_queue_overload[ht_entry.local_rx_queue]) {
+    if (allow_migration && m_rx_queue_overload[ht_entry.local_rx_queue]) {
       // core is overloaded. let's see if there is another core that is
       // available and could take over processing
       int16_t queue = calc_local_rx_queue_not_overloaded(pkt);
@@ -139,7 +334,8 @@ void Offload::handle_pkt(Packet *pkt)
         local_rx_queue = (uint8_t)queue;
       }
     } else {
-      // core is not overloaded. let's keep processing there
+      // core is not overloaded (or the entry may not be migrated). let's keep
+      // processing there
       local_rx_queue = ht_entry.local_rx_queue;
     }
   } else {
@@ -148,9 +344,17 @@ void Offload::handle_pkt(Packet *pkt)
     local_rx_queue = calc_rss_rx_queue(pkt);
   }
 
-  // if remote offloading is enabled and the previously determined core is
-  // overloaded, we prefer to offload the packet to another node
-  bool offload = m_enabled_offload && m_rx_queue_overload[local_rx_queue];
+  // if the previously determined core is overloaded, we prefer to steer the
+  // packet to the smartnic, as long as the nic is not overloaded itself, and
+  // otherwise offload it to another node. the decision is recorded for the
+  // entry regardless of the packet's traffic class, so that the flow's other
+  // packets are steered alike. packets of protected traffic classes bypass
+  // it and always stay on the host cores
+  bool protect = pkt->get_traffic_class() < m_offload_protected_classes;
+  bool overload = allow_migration && m_rx_queue_overload[local_rx_queue];
+  bool nic = m_enabled_nic_offload && overload &&
+             !m_rx_queue_overload[m_n_rx_queues];
+  bool offload = m_enabled_offload && overload && !nic;
 
   // if remote offloading is enabled and the max hop count is reached (we are
   // the last hop in the offloading ring), we must process the packet locally.
@@ -159,40 +363,255 @@ void Offload::handle_pkt(Packet *pkt)
   bool force_local =
       m_enabled_offload && (pkt->get_hop_cnt() == (m_max_hop_cnt - 1));
 
-  if ((ht_entry.valid == false) ||
-      (simTime() >= (ht_entry.t_last_arrival + m_hashtable_entry_timeout))) {
-    // the hashtable entry is either hit for the first time or the timeout has
-    // expired. in this case, we may actually write the determined local rx
-    // queue and the offload decision to the hash table
+  // if the drain barrier is enabled, the entry may be migrated as soon as all
+  // packets dispatched via it and via the entry that steered the flow before
+  // have left their path, with the timeout remaining as fallback in case the
+  // path does not drain
+  if ((ht_entry.n_in_flight_prev != NULL) &&
+      (*ht_entry.n_in_flight_prev == 0)) {
+    ht_entry.n_in_flight_prev = NULL;
+  }
+  bool drained = m_enabled_drain_barrier && (ht_entry.n_in_flight == 0) &&
+                 (ht_entry.n_in_flight_prev == NULL);
+  bool timeout = false;
+  simtime_t t_timeout = 0;
+  if (ht_entry.valid) {
+    t_timeout = calc_entry_timeout(ht_entry);
+    timeout = (simTime() >= (ht_entry.t_last_arrival + t_timeout));
+  }
+
+  if ((ht_entry.valid == false) || drained || timeout) {
+    // the hashtable entry is either hit for the first time, its packets have
+    // drained or the timeout has expired. in this case, we may actually write
+    // the determined local rx queue and the offload decision to the hash table
+    if (ht_entry.valid && ((ht_entry.offload != offload) ||
+                           (ht_entry.nic != nic) ||
+                           (ht_entry.local_rx_queue != local_rx_queue))) {
+      // entry is migrated. record why we were allowed to do so and, if the
+      // timeout allowed it, the timeout that has expired
+      if (drained) {
+        emit(m_sig_stats_n_migrations_drained, 1);
+      } else {
+        emit(m_sig_stats_n_migrations_timeout, 1);
+        emit(m_sig_stats_entry_timeout, t_timeout);
+      }
+    }
     ht_entry.offload = offload;
+    ht_entry.nic = nic;
     ht_entry.local_rx_queue = local_rx_queue;
   }
-  // mark entry as active and update last arrival time
+  // update inter-arrival gap statistics, mark entry as active and update last
+  // arrival time
+  update_entry_gap(ht_entry);
   ht_entry.valid = true;
   ht_entry.t_last_arrival = simTime();
 
-  if (ht_entry.offload && (force_local == false)) {
+  // packets of protected classes sharing an entry with offloaded traffic are
+  // kept local as well
+  if (ht_entry.offload && protect) {
+    emit(m_sig_stats_n_offload_protected, 1);
+  }
+
+  if (ht_entry.offload && (force_local == false) && !protect) {
     // offload packet if the offload flag in the hash table is set and we are
     // no the last hop in the offloading ring
+    if (m_enabled_drain_barrier) {
+      ht_entry.n_in_flight++;
+      pkt->add_in_flight_ref(m_node_id, get_entry_id(ht_entry));
+    }
     send_pkt_offload(pkt, 0);
+  } else if (ht_entry.nic && !protect) {
+    // process packet on the smartnic if the nic flag in the hash table is set
+    if (m_enabled_drain_barrier) {
+      pkt->get_node_ctx()->set_in_flight_cntr(&ht_entry.n_in_flight);
+    }
+    send_pkt_nic(pkt);
   } else {
     // otherwise place packet in the rx queue indicated in the hash table
+    if (m_enabled_drain_barrier) {
+      pkt->get_node_ctx()->set_in_flight_cntr(&ht_entry.n_in_flight);
+    }
     send_pkt_local(pkt, ht_entry.local_rx_queue);
   }
 }
 
+uint32_t Offload::get_entry_id(hashtable_entry_t &entry)
+{
+  // bucket entries are numbered first, followed by the heavy hitters' entries
+  if ((&entry >= m_hashtable) && (&entry < m_hashtable + m_hashtable_size)) {
+    return (uint32_t)(&entry - m_hashtable);
+  }
+  ASSERT(m_enabled_heavy_hitter);
+  ASSERT((&entry >= m_hh_entries) &&
+         (&entry < m_hh_entries + m_hh_sketch->get_size()));
+  return m_hashtable_size + (uint32_t)(&entry - m_hh_entries);
+}
+
+Offload::hashtable_entry_t &Offload::get_entry(uint32_t entry_id)
+{
+  if (entry_id < m_hashtable_size) {
+    return m_hashtable[entry_id];
+  }
+  ASSERT(m_enabled_heavy_hitter);
+  ASSERT(entry_id - m_hashtable_size < m_hh_sketch->get_size());
+  return m_hh_entries[entry_id - m_hashtable_size];
+}
+
+Offload::hashtable_entry_t &
+Offload::lookup_hashtable_entry(Packet *pkt, bool *allow_migration)
+{
+  // get toeplitz hash
+  uint32_t toeplitz_hash = pkt->get_flow().get_toeplitz_hash();
+
+  // lookup hashtable entry
+  hashtable_entry_t &ht_entry = m_hashtable[toeplitz_hash % m_hashtable_size];
+
+  if (!m_enabled_heavy_hitter) {
+    // all flows hitting the hash bucket are treated alike
+    *allow_migration = true;
+    return ht_entry;
+  }
+
+  // decay sketch counters, if decay interval has passed
+  if (m_hh_decay_interval > 0) {
+    while (simTime() >= m_hh_t_next_decay) {
+      m_hh_sketch->decay(m_hh_decay_factor);
+      m_hh_t_next_decay += m_hh_decay_interval;
+    }
+  }
+
+  // account the packet's instructions to its flow
+  bool slot_reassigned;
+  uint32_t slot = m_hh_sketch->update(
+      pkt->get_flow().get_key(), (double)pkt->get_instr(), &slot_reassigned);
+
+  // get the sketch slot's hashtable entry. if the slot has just been handed
+  // over to this flow, the state of the previous flow must not be used
+  hashtable_entry_t &hh_entry = m_hh_entries[slot];
+  if (slot_reassigned) {
+    hh_entry.valid = false;
+  }
+
+  // only top-k heavy hitters may be moved to another core or be offloaded
+  bool is_heavy = m_hh_sketch->is_top_k(slot);
+  *allow_migration = is_heavy;
+
+  if (is_heavy) {
+    emit(m_sig_stats_hh_n_pkts, 1);
+
+    if (hh_entry.valid == false) {
+      // flow just became a heavy hitter. start out with the state of the hash
+      // bucket that steered its packets so far, so that they keep taking the
+      // same path until the entry may be migrated. the in-flight counter
+      // stays with the slot, because packets dispatched via the slot before
+      // still reference it. the flow's packets dispatched via the bucket are
+      // not known individually, so the entry may only be migrated once the
+      // bucket has drained as well
+      uint32_t n_in_flight = hh_entry.n_in_flight;
+      hh_entry = ht_entry;
+      hh_entry.n_in_flight = n_in_flight;
+      hh_entry.n_in_flight_prev =
+          (ht_entry.n_in_flight > 0) ? &ht_entry.n_in_flight : NULL;
+    }
+    return hh_entry;
+  } else if (hh_entry.valid) {
+    // flow has been a heavy hitter before, but is not among the top-k anymore.
+    // keep using its own entry, so that its packets keep following the path
+    // of those still in flight. the entry may not be migrated to another core
+    // anymore. once it has drained or timed out, its offload and nic flags are
+    // cleared and the flow stays on the local core it was assigned last
+    return hh_entry;
+  } else {
+    // mice flows share the hash bucket entry
+    return ht_entry;
+  }
+}
+
+simtime_t Offload::calc_entry_timeout(hashtable_entry_t &ht_entry)
+{
+  ASSERT(ht_entry.valid);
+
+  if (!m_enabled_adaptive_timeout) {
+    // all entries use the same timeout
+    return m_hashtable_entry_timeout;
+  }
+
+  // once no packet has hit the entry for a multiple of its usual packet
+  // inter-arrival gap, the current flowlet has ended and the entry may be
+  // migrated. the timeout is at least the largest gap recently observed, so
+  // that a gap within a flowlet never lets the entry migrate, and bounded by
+  // the configured hashtable entry timeout
+  simtime_t timeout = m_adaptive_timeout_factor * ht_entry.gap_ewma;
+  if (timeout < ht_entry.gap_max) {
+    timeout = ht_entry.gap_max;
+  }
+  if (timeout > m_hashtable_entry_timeout) {
+    timeout = m_hashtable_entry_timeout;
+  }
+  if (timeout < m_adaptive_timeout_min) {
+    timeout = m_adaptive_timeout_min;
+  }
+
+  return timeout;
+}
+
+void Offload::update_entry_gap(hashtable_entry_t &ht_entry)
+{
+  if (!m_enabled_adaptive_timeout) {
+    return;
+  }
+
+  if (ht_entry.valid == false) {
+    // entry is hit for the first time. until we have seen some gaps, start
+    // out with the configured hashtable entry timeout
+    ht_entry.gap_ewma = m_hashtable_entry_timeout / m_adaptive_timeout_factor;
+    ht_entry.gap_max = m_hashtable_entry_timeout;
+    return;
+  }
+
+  // get gap since the last packet hit the entry
+  simtime_t gap = simTime() - ht_entry.t_last_arrival;
+
+  // update moving average
+  ht_entry.gap_ewma = (1.0 - m_adaptive_timeout_alpha) * ht_entry.gap_ewma +
+                      m_adaptive_timeout_alpha * gap;
+
+  // update max. gap. the max. decays at the rate of the moving average, so
+  // that a single large gap in the past does not keep the timeout high forever
+  ht_entry.gap_max = (1.0 - m_adaptive_timeout_alpha) * ht_entry.gap_max;
+  if (gap > ht_entry.gap_max) {
+    ht_entry.gap_max = gap;
+  }
+}
+
 void Offload::handle_offload_trigger(OffloadTriggerMsg *msg)
 {
-  // when an offload trigger message is received, local core balancing or remote
-  // offloading must be enabled
-  ASSERT(m_enabled_balance_cores || m_enabled_offload);
+  // when an offload trigger message is received, local core balancing, remote
+  // offloading or nic offloading must be enabled
+  ASSERT(m_enabled_balance_cores || m_enabled_offload || m_enabled_nic_offload);
 
   // mark rx queue as overloaded/not overloaded
-  m_rx_queue_overload[msg->getQueueId()] = msg->getActive();
+  set_rx_queue_overload(msg->getQueueId(), msg->getActive());
 
   delete msg;
 }
 
+void Offload::set_rx_queue_overload(uint8_t queue_id, bool overload)
+{
+  // called by the offload trigger directly on the fast path
+  Enter_Method_Silent();
+
+  m_rx_queue_overload[queue_id] = overload;
+}
+
+void Offload::receive_pkt(Packet *pkt)
+{
+  // packet handed over by the ingress module on the fast path
+  Enter_Method_Silent();
+  take(pkt);
+  handle_pkt(pkt);
+}
+
 void Offload::send_pkt_local(Packet *pkt, uint8_t rx_queue)
 {
   // get packet's node context
@@ -205,13 +624,124 @@ void Offload::send_pkt_local(Packet *pkt, uint8_t rx_queue)
   ctx->set_rx_queue(rx_queue);
 
   // send packet to local node for processing
-  send(pkt, "out_proc");
+  if (m_module_proc) {
+    m_module_proc->receive_pkt(pkt);
+  } else {
+    pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(pkt, "out_proc");
+  }
 }
 
 void Offload::send_pkt_offload(Packet *pkt, int32_t port)
 {
-  // offload packet to another node
-  send(pkt, "out", port);
+  // if enabled, select the node the packet shall be offloaded to. otherwise
+  // the tor switch forwards it to our neighbor in the ring
+  if (m_enabled_p2c_offload) {
+    pkt->set_offload_target(select_offload_target(pkt));
+  }
+
+  // offload packet to another node. it does not occupy a slot in the rx queues
+  m_module_flow_control->report_pkt_forwarded();
+  if (!m_modules_out_buffer.empty()) {
+    ASSERT(port < (int32_t)m_modules_out_buffer.size());
+    m_modules_out_buffer[port]->receive_pkt(pkt);
+  } else {
+    pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(pkt, "out", port);
+  }
+}
+
+void Offload::send_pkt_nic(Packet *pkt)
+{
+  m_n_pkts_nic++;
+
+  // send packet to the smartnic for processing. the nic is reached by a
+  // message on the fast path as well
+  pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+  send(pkt, "out_nic");
+}
+
+void Offload::update_peer_load(Packet *pkt)
+{
+  // get the id of the node that stamped its load onto the packet
+  uint8_t node_id = pkt->get_load_stamp_node_id();
+  ASSERT(node_id < m_n_nodes);
+
+  // save load and when we learned about it
+  m_peer_load[node_id] = pkt->get_load_stamp();
+  m_peer_load_t_update[node_id] = simTime();
+  m_peer_load_valid[node_id] = true;
+}
+
+double Offload::calc_peer_load_mean()
+{
+  // mean load of the peers we have heard from, each weighted by how fresh the
+  // information is
+  double load_sum = 0.0;
+  double weight_sum = 0.0;
+  for (uint8_t i = 0; i < m_n_nodes; i++) {
+    if (m_peer_load_valid[i]) {
+      simtime_t age = simTime() - m_peer_load_t_update[i];
+      double weight = exp(-(age / m_peer_load_decay));
+      load_sum += weight * m_peer_load[i];
+      weight_sum += weight;
+    }
+  }
+  return (weight_sum > 0.0) ? (load_sum / weight_sum) : 0.0;
+}
+
+double Offload::calc_peer_load(uint8_t node_id, double load_mean)
+{
+  // the older the information we have on the peer's load is, the less we
+  // trust it. the estimate decays exponentially with the time since the last
+  // update towards the mean load of the peers, so that peers we have not
+  // heard from for a while look neither idle nor busy
+  if (!m_peer_load_valid[node_id]) {
+    return load_mean;
+  }
+  simtime_t age = simTime() - m_peer_load_t_update[node_id];
+  double weight = exp(-(age / m_peer_load_decay));
+  return weight * m_peer_load[node_id] + (1.0 - weight) * load_mean;
+}
+
+uint8_t Offload::select_offload_target(Packet *pkt)
+{
+  // collect all peers the packet has not visited yet
+  uint8_t candidates[m_n_nodes];
+  uint8_t n_candidates = 0;
+  for (uint8_t i = 0; i < m_n_nodes; i++) {
+    if (!pkt->is_visited(i)) {
+      candidates[n_candidates] = i;
+      n_candidates++;
+    }
+  }
+
+  // packets are only offloaded if they are not on their last hop, so there
+  // must be at least one peer left
+  ASSERT(n_candidates > 0);
+
+  // sample two distinct peers and select the one with the lower load
+  uint8_t idx_target = intuniform(0, n_candidates - 1);
+  uint8_t target = candidates[idx_target];
+  double load_mean = calc_peer_load_mean();
+  if (n_candidates > 1) {
+    // draw the second sample from the remaining candidates
+    uint8_t idx_other = intuniform(0, n_candidates - 2);
+    if (idx_other >= idx_target) {
+      idx_other++;
+    }
+    uint8_t other = candidates[idx_other];
+    if (calc_peer_load(other, load_mean) <
+        calc_peer_load(target, load_mean)) {
+      target = other;
+    }
+  }
+
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_p2c_target_load, calc_peer_load(target, load_mean));
+  }
+
+  return target;
 }
 
 int16_t Offload::calc_local_rx_queue_not_overloaded(Packet *pkt)
@@ -237,7 +767,7 @@ int16_t Offload::calc_local_rx_queue_not_overloaded(Packet *pkt)
   } else {
     // found at least one core that is not overloaded. select an entry from the
     // list based on toeplitz hash
-    return selected_queues[pkt->get_flow()->get_toeplitz_hash() %
+    return selected_queues[pkt->get_flow().get_toeplitz_hash() %
                            len_selected_queues];
   }
 }
@@ -245,12 +775,31 @@ int16_t Offload::calc_local_rx_queue_not_overloaded(Packet *pkt)
 uint32_t Offload::calc_rss_rx_queue(Packet *pkt)
 {
   // determine and return target rx queue id based on rss reta
-  return m_rss_reta[pkt->get_flow()->get_toeplitz_hash() % m_rss_reta_size];
+  return m_rss_reta[pkt->get_flow().get_toeplitz_hash() % m_rss_reta_size];
 }
 
-void Offload::update_rss_reta_entry(uint16_t entry, uint8_t rx_queue)
+void Offload::handle_in_flight_release(InFlightReleaseMsg *msg)
+{
+  ASSERT(m_enabled_drain_barrier);
+  ASSERT(msg->getNodeIdsArraySize() == msg->getEntryIdsArraySize());
+
+  // packets offloaded via the entries are not in flight anymore
+  for (size_t i = 0; i < msg->getEntryIdsArraySize(); i++) {
+    ASSERT(msg->getNodeIds(i) == m_node_id);
+    hashtable_entry_t &ht_entry = get_entry(msg->getEntryIds(i));
+    ASSERT(ht_entry.n_in_flight > 0);
+    ht_entry.n_in_flight--;
+  }
+
+  delete msg;
+}
+
+void Offload::handle_reta_update(RetaUpdateMsg *msg)
 {
   // update rss reta entry
-  ASSERT(entry < m_rss_reta_size);
-  m_rss_reta[entry] = rx_queue;
+  ASSERT(msg->getEntry() < m_rss_reta_size);
+  ASSERT(msg->getRxQueue() < m_n_rx_queues);
+  m_rss_reta[msg->getEntry()] = msg->getRxQueue();
+
+  delete msg;
 }
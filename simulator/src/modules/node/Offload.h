@@ -2,37 +2,64 @@
 #define MODULES_NODE_OFFLOAD_H_
 
 #include <omnetpp.h>
+#include <vector>
 
 using namespace omnetpp;
 
+class FlowControl;
+class OutputBuffer;
 class Packet;
+class Processing;
+class InFlightReleaseMsg;
 class OffloadTriggerMsg;
+class RetaUpdateMsg;
+class HeavyHitterSketch;
 
 class Offload : public cSimpleModule
 {
 public:
   virtual ~Offload();
 
-  // TODO: implement by exchanging messages between processing and offloading
-  // modules
-  void update_rss_reta_entry(uint16_t entry, uint8_t rx_queue);
+  void receive_pkt(Packet *pkt);
+  void set_rx_queue_overload(uint8_t queue_id, bool overload);
 
 protected:
   virtual void initialize();
   virtual void handleMessage(cMessage *msg);
+  virtual void handleParameterChange(const char *name);
+  virtual void finish();
 
 private:
   typedef struct {
     bool valid;
     uint8_t local_rx_queue;
     bool offload;
+    bool nic; // steer to the smartnic
     simtime_t t_last_arrival;
+    uint32_t n_in_flight; // number of packets dispatched but not yet drained
+    uint32_t *n_in_flight_prev; // in-flight counter of the entry that steered
+                                // the flow before, until it has drained
+    simtime_t gap_ewma;   // moving average of packet inter-arrival gap
+    simtime_t gap_max;    // (slowly decaying) max. packet inter-arrival gap
   } hashtable_entry_t;
 
   void handle_pkt(Packet *pkt);
+  hashtable_entry_t &lookup_hashtable_entry(Packet *pkt,
+                                            bool *allow_migration);
+  uint32_t get_entry_id(hashtable_entry_t &entry);
+  hashtable_entry_t &get_entry(uint32_t entry_id);
+  simtime_t calc_entry_timeout(hashtable_entry_t &ht_entry);
+  void update_entry_gap(hashtable_entry_t &ht_entry);
   void handle_offload_trigger(OffloadTriggerMsg *msg);
+  void handle_reta_update(RetaUpdateMsg *msg);
+  void handle_in_flight_release(InFlightReleaseMsg *msg);
   void send_pkt_local(Packet *pkt, uint8_t rx_queue);
   void send_pkt_offload(Packet *pkt, int32_t port);
+  void send_pkt_nic(Packet *pkt);
+  void update_peer_load(Packet *pkt);
+  double calc_peer_load_mean();
+  double calc_peer_load(uint8_t node_id, double load_mean);
+  uint8_t select_offload_target(Packet *pkt);
   int16_t calc_local_rx_queue_not_overloaded(Packet *pkt);
   uint32_t calc_rss_rx_queue(Packet *pkt);
 
@@ -40,14 +67,49 @@ private:
 
   bool m_enabled_balance_cores;
   bool m_enabled_offload;
+  bool m_enabled_nic_offload;
   uint32_t m_hashtable_size;
   simtime_t m_hashtable_entry_timeout;
+  bool m_enabled_drain_barrier;
+  bool m_enabled_adaptive_timeout;
+  double m_adaptive_timeout_alpha;
+  double m_adaptive_timeout_factor;
+  simtime_t m_adaptive_timeout_min;
   uint8_t m_max_hop_cnt;
+  uint8_t m_offload_protected_classes;
   uint8_t m_n_rx_queues;
   bool *m_rx_queue_overload;
 
   uint16_t m_rss_reta_size;
   uint8_t *m_rss_reta;
+
+  bool m_enabled_heavy_hitter;
+  HeavyHitterSketch *m_hh_sketch;
+  hashtable_entry_t *m_hh_entries;
+  simtime_t m_hh_decay_interval;
+  double m_hh_decay_factor;
+  simtime_t m_hh_t_next_decay;
+
+  bool m_enabled_p2c_offload;
+  uint8_t m_node_id;
+  uint8_t m_n_nodes;
+  simtime_t m_peer_load_decay;
+  uint32_t *m_peer_load;
+  simtime_t *m_peer_load_t_update;
+  bool *m_peer_load_valid;
+
+  FlowControl *m_module_flow_control;
+  Processing *m_module_proc;
+  Processing *m_module_proc_lazy;
+  std::vector<OutputBuffer *> m_modules_out_buffer;
+
+  simsignal_t m_sig_stats_hh_n_pkts;
+  simsignal_t m_sig_stats_n_migrations_drained;
+  simsignal_t m_sig_stats_n_migrations_timeout;
+  simsignal_t m_sig_stats_entry_timeout;
+  simsignal_t m_sig_stats_p2c_target_load;
+  simsignal_t m_sig_stats_n_offload_protected;
+  uint64_t m_n_pkts_nic;
 };
 
 #endif
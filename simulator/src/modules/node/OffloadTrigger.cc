@@ -2,6 +2,9 @@
 #include "../../defines.h"
 #include "../../msgs/OffloadTriggerMsg_m.h"
 #include "../../msgs/Packet.h"
+#include "../../msgs/QueueLenMsg_m.h"
+#include "../Profiler.h"
+#include "Offload.h"
 
 Define_Module(OffloadTrigger)
 
@@ -28,6 +31,15 @@ void OffloadTrigger::initialize()
   // get number of rx queues
   m_n_rx_queues = par("n_rx_queues");
 
+  // on the fast path, trigger updates are passed to the offload module by a
+  // direct call instead of a message
+  m_module_offload = NULL;
+  if (par("enable_fast_path").boolValue()) {
+    m_module_offload = (Offload *)gate("offloadTriggerOut")
+                           ->getPathEndGate()
+                           ->getOwnerModule();
+  }
+
   // initially disable offloading on all queues
   m_offload_enabled = new bool[m_n_rx_queues];
   for (uint8_t i = 0; i < m_n_rx_queues; i++) {
@@ -37,7 +49,35 @@ void OffloadTrigger::initialize()
 
 void OffloadTrigger::handleMessage(cMessage *msg)
 {
-  throw cRuntimeError("this module should not receive messages");
+  PROFILE_HANDLE_MESSAGE("OffloadTrigger");
+
+  // the processing modules report the length of their queues whenever a packet
+  // is taken out of them
+  ASSERT(msg->getKind() == MSG_KIND_QUEUE_LEN);
+  QueueLenMsg *queue_len_msg = (QueueLenMsg *)msg;
+  report_queue_len(queue_len_msg->getQueueId(),
+                   queue_len_msg->getQueueLen());
+
+  delete msg;
+}
+
+void OffloadTrigger::handleParameterChange(const char *name)
+{
+  // the threshold may be changed during the simulation (e.g. by variants
+  // warm-started from a checkpoint). it applies from the next queue length
+  // report on
+  if (strcmp(name, "threshold") == 0) {
+    m_threshold = par("threshold");
+  } else {
+    throw cRuntimeError("parameter '%s' cannot be changed during simulation",
+                        name);
+  }
+}
+
+uint32_t OffloadTrigger::get_threshold()
+{
+  // return the queue length above which traffic is offloaded
+  return m_threshold;
 }
 
 bool OffloadTrigger::is_offload_enabled(uint8_t queue_id)
@@ -63,12 +103,17 @@ void OffloadTrigger::set_offload_enable(uint8_t queue_id, bool enable)
   // module
   m_offload_enabled[queue_id] = enable;
 
-  // then also send a trigger message to the offload module informing it of the
-  // updated queue state
+  // then also inform the offload module of the updated queue state, either
+  // directly or by sending a trigger message
+  if (m_module_offload) {
+    m_module_offload->set_rx_queue_overload(queue_id, enable);
+    return;
+  }
   OffloadTriggerMsg *msg = new OffloadTriggerMsg;
   msg->setKind(MSG_KIND_OFFLOAD_TRIGGER);
   msg->setQueueId(queue_id);
   msg->setActive(enable);
+  msg->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
   send(msg, "offloadTriggerOut");
 }
 
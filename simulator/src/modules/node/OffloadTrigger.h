@@ -5,6 +5,7 @@
 
 using namespace omnetpp;
 
+class Offload;
 class Packet;
 
 class OffloadTrigger : public cSimpleModule
@@ -12,10 +13,12 @@ class OffloadTrigger : public cSimpleModule
 public:
   virtual ~OffloadTrigger();
   void report_queue_len(uint8_t queue_id, uint32_t queue_len);
+  uint32_t get_threshold();
 
 protected:
   virtual void initialize();
   virtual void handleMessage(cMessage *msg);
+  virtual void handleParameterChange(const char *name);
 
   bool is_offload_enabled(uint8_t queue_id);
   void set_offload_enable(uint8_t queue_id, bool enable);
@@ -25,6 +28,8 @@ protected:
   uint8_t m_n_rx_queues;
 
   bool *m_offload_enabled;
+
+  Offload *m_module_offload;
 };
 
 #endif
@@ -1,12 +1,19 @@
 #include "OutputBuffer.h"
 #include "../../defines.h"
+#include "../../msgs/InFlightReleaseMsg_m.h"
 #include "../../msgs/Packet.h"
 #include "../../msgs/PacketNodeContext.h"
-#include "Processing.h"
+#include "../PacketScheduler.h"
+#include "../Profiler.h"
+#include "IProcessing.h"
 
 Define_Module(OutputBuffer);
 
-OutputBuffer::~OutputBuffer() { cancelAndDelete(m_self_msg); }
+OutputBuffer::~OutputBuffer()
+{
+  cancelAndDelete(m_self_msg);
+  delete m_pkt_queue;
+}
 
 void OutputBuffer::initialize()
 {
@@ -14,37 +21,228 @@ void OutputBuffer::initialize()
   m_self_msg = new cMessage();
 
   m_out_channel = gate("out")->getTransmissionChannel();
+
+  // create packet queue
+  m_pkt_queue = new PacketScheduler(
+      par("scheduler"), par("scheduler_order"), par("n_traffic_classes"),
+      par("scheduler_weights"), par("scheduler_quantum"),
+      par("queue_capacity"));
+  m_sig_stats_drop_class = registerSignal("stats_drop_class");
+
+  // stamp node's load onto outgoing packets?
+  m_enabled_load_stamp = par("enable_load_stamp");
+  m_node_id = par("node_id");
+
+  // get pointer on processing module, which provides the load
+  m_module_proc = NULL;
+  if (m_enabled_load_stamp) {
+    m_module_proc = dynamic_cast<IProcessing *>(getModuleByPath("^.proc"));
+    if (m_module_proc == NULL) {
+      throw cRuntimeError("load stamps require a processing module "
+                          "implementing IProcessing");
+    }
+  }
+
+  // flow control towards the tor switch. in credit mode, transmission starts
+  // once the switch has granted credits
+  m_fc_mode = FlowControl::parse_mode(par("flow_control_mode"));
+  m_paused = false;
+  m_credits = 0;
+  m_hol_blocked = false;
+  m_sig_stats_paused = registerSignal("stats_paused");
+  m_sig_stats_hol_blocked = registerSignal("stats_hol_blocked");
+  m_sig_stats_hol_blocking_time = registerSignal("stats_hol_blocking_time");
+
+  // compute departure times from the link rate instead of scheduling an event
+  // per transmitted packet? this requires departures in arrival order
+  m_analytical_departures = par("analytical_departures");
+  m_queue_capacity = par("queue_capacity");
+  m_t_link_free = 0;
+  if (m_analytical_departures &&
+      ((strcmp(par("scheduler").stringValue(), "fifo") != 0) ||
+       (strcmp(par("scheduler_order").stringValue(), "fifo") != 0) ||
+       (m_fc_mode != FlowControl::FC_NONE))) {
+    throw cRuntimeError("analytical departures require fifo scheduling and no "
+                        "flow control");
+  }
 }
 
 void OutputBuffer::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("OutputBuffer");
+
   if (msg->isSelfMessage()) {
     // packet transmission on the link is done
-    if (m_pkt_queue.getLength() == 0) {
-      // no more packets to be sent. do nothing.
+    if (m_pkt_queue->is_empty() || !can_send()) {
+      // no more packets to be sent or flow control does not allow sending.
+      // do nothing.
       m_waiting_for_input = true;
+      update_hol_blocking();
     } else {
       // send next packet
       send_packet();
     }
   } else {
-    // packet arriving. insert into queue
-    cPacket *pkt = (cPacket *)msg;
-    m_pkt_queue.insert(pkt);
-
-    // if no transmission on the output link is ongoing, send the packet right
-    // away
-    if (m_waiting_for_input) {
-      m_waiting_for_input = false;
-      send_packet();
-    }
+    // packet arriving
+    handle_packet((cPacket *)msg);
+  }
+}
+
+void OutputBuffer::receive_pkt(cPacket *pkt)
+{
+  // packet handed over by the offload or processing module on the fast path
+  Enter_Method_Silent();
+  take(pkt);
+  handle_packet(pkt);
+}
+
+void OutputBuffer::handle_packet(cPacket *pkt)
+{
+  // remember when the packet entered the buffer. packets handed over on the
+  // fast path do not carry a matching arrival time
+  pkt->setTimestamp(simTime());
+
+  // with analytical departures, the packet is sent right away with a delay
+  // covering the transmissions ahead of it
+  if (m_analytical_departures) {
+    send_packet_analytical(pkt);
+    return;
+  }
+
+  // insert into queue. if the queue is full, the packet is dropped
+  if (m_pkt_queue->insert(pkt) == false) {
+    drop_packet(pkt);
+    return;
+  }
+
+  // if no transmission on the output link is ongoing, send the packet right
+  // away
+  try_send();
+}
+
+void OutputBuffer::set_paused(bool paused)
+{
+  Enter_Method_Silent();
+
+  // pfc pause/resume received from the switch. the pause only takes effect
+  // after the ongoing transmission
+  ASSERT(m_fc_mode == FlowControl::FC_PFC);
+  ASSERT(m_paused != paused);
+  m_paused = paused;
+  emit(m_sig_stats_paused, paused);
+
+  try_send();
+}
+
+void OutputBuffer::add_credits(int32_t n_credits)
+{
+  Enter_Method_Silent();
+
+  // switch has freed buffer space
+  ASSERT(m_fc_mode == FlowControl::FC_CREDIT);
+  m_credits += n_credits;
+
+  try_send();
+}
+
+bool OutputBuffer::can_send()
+{
+  // does flow control allow to send another packet to the switch?
+  if (m_fc_mode == FlowControl::FC_PFC) {
+    return !m_paused;
+  } else if (m_fc_mode == FlowControl::FC_CREDIT) {
+    return m_credits > 0;
+  }
+  return true;
+}
+
+void OutputBuffer::try_send()
+{
+  // start transmission if the link is idle and a packet may be sent
+  if (m_waiting_for_input && !m_pkt_queue->is_empty() && can_send()) {
+    m_waiting_for_input = false;
+    send_packet();
+  }
+  update_hol_blocking();
+}
+
+void OutputBuffer::update_hol_blocking()
+{
+  // the queue is head-of-line blocked if packets are waiting while the link is
+  // idle. this only happens when flow control holds back transmission
+  bool hol_blocked = m_waiting_for_input && !m_pkt_queue->is_empty();
+  if (hol_blocked == m_hol_blocked) {
+    return;
+  }
+
+  m_hol_blocked = hol_blocked;
+  emit(m_sig_stats_hol_blocked, hol_blocked);
+  if (hol_blocked) {
+    m_t_hol_blocked_start = simTime();
+  } else {
+    emit(m_sig_stats_hol_blocking_time, simTime() - m_t_hol_blocked_start);
   }
 }
 
 void OutputBuffer::send_packet()
 {
   // pop packet form queue
-  cPacket *msg = (cPacket *)m_pkt_queue.pop();
+  cPacket *msg = m_pkt_queue->pop();
+
+  // each packet consumes one of the credits granted by the switch
+  if (m_fc_mode == FlowControl::FC_CREDIT) {
+    ASSERT(m_credits > 0);
+    m_credits--;
+  }
+
+  // get the time the packet spent in the output buffer
+  prepare_packet(msg, simTime() - msg->getTimestamp());
+
+  // send packet out
+  send(msg, "out");
+
+  // schedule self message that is triggered once the packet has completely been
+  // transmitted
+  scheduleAt(m_out_channel->getTransmissionFinishTime(), m_self_msg);
+}
+
+void OutputBuffer::send_packet_analytical(cPacket *msg)
+{
+  // forget the packets whose transmission has started already. the remaining
+  // ones are still waiting in the buffer
+  while (!m_t_departures.empty() && (m_t_departures.front() <= simTime())) {
+    m_t_departures.pop_front();
+  }
+
+  // if the buffer is full, the packet is dropped
+  if ((m_queue_capacity > 0) && (m_t_departures.size() >= m_queue_capacity)) {
+    drop_packet(msg);
+    return;
+  }
+
+  // the packet's transmission starts as soon as the packets ahead of it have
+  // been transmitted
+  simtime_t t_start = simTime();
+  if (m_t_link_free > t_start) {
+    t_start = m_t_link_free;
+  }
+  m_t_link_free = t_start + m_out_channel->calculateDuration(msg);
+  m_t_departures.push_back(t_start);
+
+  // the time the packet spends in the output buffer is known already. the
+  // load stamp reflects the node's load at the time the packet is buffered
+  simtime_t t_lat_buffer = t_start - simTime();
+  prepare_packet(msg, t_lat_buffer);
+
+  // send packet out once its transmission starts
+  sendDelayed(msg, t_lat_buffer, "out");
+}
+
+void OutputBuffer::prepare_packet(cPacket *msg, simtime_t t_lat_buffer)
+{
+  // the packet leaves the node, so it is not handed over between its stages
+  // anymore
+  msg->setSchedulingPriority(MSG_PRIORITY_DEFAULT);
 
   if (msg->getKind() == MSG_KIND_PACKET_DATA) {
     // this is a data packet
@@ -53,23 +251,38 @@ void OutputBuffer::send_packet()
     // increment its hop count
     pkt->incrm_hop_cnt();
 
-    // clear node context
+    // clear node context. processing is done, so the packet must not hold the
+    // local in-flight counter anymore
+    ASSERT(!pkt->get_node_ctx()->has_in_flight_cntr());
     pkt->get_node_ctx()->clear();
 
-    // get the time the packet spent in the output buffer
-    simtime_t t_lat_buffer = simTime() - pkt->getArrivalTime();
+    // let the next node know how loaded we are
+    if (m_enabled_load_stamp) {
+      pkt->set_load_stamp(m_node_id, m_module_proc->get_total_queue_len());
+    }
 
-    // ... and record this time
+    // record the time the packet spent in the output buffer
     Latency *latency = pkt->get_latency();
     LatencyElement *latency_buffer =
         new LatencyElement(LatencyElement::NODE_BUFFER_OUT, t_lat_buffer);
     latency->add_element(latency_buffer);
   }
+}
 
-  // send packet out
-  send(msg, "out");
+void OutputBuffer::drop_packet(cPacket *msg)
+{
+  // report traffic class of the dropped packet
+  emit(m_sig_stats_drop_class, m_pkt_queue->get_traffic_class(msg));
 
-  // schedule self message that is triggered once the packet has completely been
-  // transmitted
-  scheduleAt(m_out_channel->getTransmissionFinishTime(), m_self_msg);
+  if (msg->getKind() == MSG_KIND_PACKET_DATA) {
+    // packet leaves the local and offloading paths. the tor switch routes the
+    // release of offloaded packets to the nodes they have passed
+    Packet *pkt = (Packet *)msg;
+    pkt->get_node_ctx()->release_in_flight_cntr();
+    if (pkt->has_in_flight_refs()) {
+      send(pkt->create_in_flight_release(), "release_out");
+    }
+  }
+
+  delete msg;
 }
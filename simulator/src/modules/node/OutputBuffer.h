@@ -1,27 +1,64 @@
 #ifndef MODULES_NODE_OUTPUTBUFFER_H_
 #define MODULES_NODE_OUTPUTBUFFER_H_
 
+#include <deque>
 #include <omnetpp.h>
 
+#include "FlowControl.h"
+
 using namespace omnetpp;
 
+class IProcessing;
+class PacketScheduler;
+
 class OutputBuffer : public cSimpleModule
 {
 public:
   virtual ~OutputBuffer();
 
+  void set_paused(bool paused);
+  void add_credits(int32_t n_credits);
+  void receive_pkt(cPacket *pkt);
+
 protected:
   virtual void initialize();
   virtual void handleMessage(cMessage *msg);
 
 private:
+  void handle_packet(cPacket *pkt);
   void send_packet();
+  void send_packet_analytical(cPacket *msg);
+  void prepare_packet(cPacket *msg, simtime_t t_lat_buffer);
+  void drop_packet(cPacket *msg);
+  bool can_send();
+  void try_send();
+  void update_hol_blocking();
 
-  cPacketQueue m_pkt_queue;
+  PacketScheduler *m_pkt_queue;
 
   bool m_waiting_for_input;
   cMessage *m_self_msg;
   cChannel *m_out_channel;
+
+  bool m_analytical_departures;
+  uint32_t m_queue_capacity;
+  simtime_t m_t_link_free;              // time the last transmission finishes
+  std::deque<simtime_t> m_t_departures; // transmission start of buffered pkts
+
+  bool m_enabled_load_stamp;
+  uint8_t m_node_id;
+  IProcessing *m_module_proc;
+
+  FlowControl::fc_mode_t m_fc_mode;
+  bool m_paused;     // pfc: transmission paused by the switch
+  int32_t m_credits; // credit: packets the switch can still accept
+  bool m_hol_blocked;
+  simtime_t m_t_hol_blocked_start;
+
+  simsignal_t m_sig_stats_drop_class;
+  simsignal_t m_sig_stats_paused;
+  simsignal_t m_sig_stats_hol_blocked;
+  simsignal_t m_sig_stats_hol_blocking_time;
 };
 
 #endif
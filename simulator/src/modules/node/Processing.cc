@@ -1,8 +1,15 @@
 #include "Processing.h"
 #include "../../defines.h"
+#include "../../msgs/InFlightReleaseMsg_m.h"
 #include "../../msgs/Packet.h"
 #include "../../msgs/PacketNodeContext.h"
+#include "../../msgs/ProcDoneMsg_m.h"
+#include "../../msgs/QueueLenMsg_m.h"
+#include "../PacketScheduler.h"
+#include "../Profiler.h"
+#include "FlowControl.h"
 #include "OffloadTrigger.h"
+#include "OutputBuffer.h"
 
 Define_Module(Processing)
 
@@ -22,6 +29,14 @@ Define_Module(Processing)
     cancelAndDelete(core.msg_proc_done);
   }
 
+  // cancel frequency governor event
+  cancelAndDelete(m_msg_dvfs_tick);
+
+  // delete rx queues including the packets waiting in them
+  for (uint8_t i = 0; i < m_rx_queues.size(); i++) {
+    delete m_rx_queues[i].pkts;
+  }
+
   delete[] m_t_inst;
   delete[] m_sigs_stats_proc_util_core;
   delete[] m_sigs_stats_queue_len;
@@ -29,19 +44,98 @@ Define_Module(Processing)
 
 void Processing::initialize()
 {
-  // get the number of CPU cores
+  // get the number of CPU cores and rx queues
   m_n_cores = par("n_cores");
+  m_n_rx_queues = par("n_rx_queues");
+  if (m_n_rx_queues < m_n_cores) {
+    throw cRuntimeError("there must be at least one rx queue per core");
+  }
 
   // get the per CPU core processing capacity (instructions/seconds)
   double capacity_per_core = par("capacity_per_core");
 
   // calculate the duration of one CPU instruction
-  simtime_t t_inst = 1.0 / capacity_per_core;
+  m_t_inst_base = 1.0 / capacity_per_core;
 
   // initialize all CPU cores with the same capacity
   m_t_inst = new simtime_t[m_n_cores];
   for (uint8_t i = 0; i < m_n_cores; i++) {
-    set_t_inst(i, t_inst);
+    set_t_inst(i, m_t_inst_base);
+  }
+
+  // get calibration table of the shared resource contention model. entry i
+  // holds the slowdown of the instruction time when i+1 cores are busy. if the
+  // table has less entries than there are cores, the last entry applies to all
+  // higher numbers of busy cores. an empty table disables the model
+  m_contention_slowdown =
+      cStringTokenizer(par("contention_slowdown").stringValue())
+          .asDoubleVector();
+  m_enabled_contention = !m_contention_slowdown.empty();
+
+  // cores 2i and 2i+1 are smt siblings sharing one physical core?
+  m_smt_siblings = par("smt_siblings");
+  m_smt_slowdown = par("smt_slowdown");
+
+  // get the frequency states of the cores. each state is a factor that the
+  // nominal capacity is scaled with. an empty list disables frequency scaling
+  m_dvfs_freqs =
+      cStringTokenizer(par("dvfs_freqs").stringValue()).asDoubleVector();
+  m_enabled_dvfs = !m_dvfs_freqs.empty();
+  for (size_t i = 0; i < m_dvfs_freqs.size(); i++) {
+    if ((m_dvfs_freqs[i] <= 0.0) ||
+        ((i > 0) && (m_dvfs_freqs[i] <= m_dvfs_freqs[i - 1]))) {
+      throw cRuntimeError("dvfs_freqs must be positive and ascending");
+    }
+  }
+  if (!m_enabled_dvfs) {
+    // single frequency state at nominal capacity
+    m_dvfs_freqs.push_back(1.0);
+  }
+
+  // get frequency governor configuration
+  std::string governor = par("dvfs_governor").stdstringValue();
+  if (governor == "ondemand") {
+    m_dvfs_governor_schedutil = false;
+  } else if (governor == "schedutil") {
+    m_dvfs_governor_schedutil = true;
+  } else {
+    throw cRuntimeError("unknown dvfs governor '%s'", governor.c_str());
+  }
+  m_dvfs_window = par("dvfs_window").doubleValue();
+  m_dvfs_up_threshold = par("dvfs_up_threshold");
+  m_dvfs_transition_latency = par("dvfs_transition_latency").doubleValue();
+  ASSERT(m_dvfs_window > 0);
+
+  // get per-core power model
+  m_power_static = par("power_static");
+  m_power_dynamic = par("power_dynamic");
+  m_power_idle = par("power_idle");
+  m_enabled_energy =
+      (m_power_static > 0.0) || (m_power_dynamic > 0.0) || (m_power_idle > 0.0);
+  m_n_pkts_processed = 0;
+  m_n_instr_processed = 0;
+
+  // get core sleep state configuration
+  m_cstate_residency =
+      cStringTokenizer(par("cstate_residency").stringValue()).asDoubleVector();
+  m_cstate_exit_latency =
+      cStringTokenizer(par("cstate_exit_latency").stringValue())
+          .asDoubleVector();
+  m_cstate_power =
+      cStringTokenizer(par("cstate_power").stringValue()).asDoubleVector();
+  m_enabled_cstates = !m_cstate_residency.empty();
+  if (m_cstate_exit_latency.size() != m_cstate_residency.size()) {
+    throw cRuntimeError("cstate_residency and cstate_exit_latency must have "
+                        "the same number of entries");
+  }
+  if (!m_cstate_power.empty() &&
+      (m_cstate_power.size() != m_cstate_residency.size())) {
+    throw cRuntimeError("cstate_power must have one entry per sleep state");
+  }
+  for (size_t i = 1; i < m_cstate_residency.size(); i++) {
+    if (m_cstate_residency[i] <= m_cstate_residency[i - 1]) {
+      throw cRuntimeError("cstate_residency must be ascending");
+    }
   }
 
   // record total capacity
@@ -51,21 +145,96 @@ void Processing::initialize()
   // utilization)
   m_sig_stats_ipp = registerSignal("stats_ipp");
   m_sig_stats_proc_util = registerSignal("stats_proc_util");
+  m_sig_stats_contention_slowdown =
+      registerSignal("stats_contention_slowdown");
+  m_sig_stats_dvfs_freq = registerSignal("stats_dvfs_freq");
+  m_sig_stats_dvfs_transition = registerSignal("stats_dvfs_transition");
+  m_sig_stats_energy_pkt = registerSignal("stats_energy_pkt");
+  m_sig_stats_cstate = registerSignal("stats_cstate");
+  m_sig_stats_drop_class = registerSignal("stats_drop_class");
+  m_sig_stats_cstate_exit_latency =
+      registerSignal("stats_cstate_exit_latency");
 
-  // register signals for stats collection (per-core utilization, queue lengths)
-  // and create core_t struct including self-messages for per-core event
+  // get rx queue polling discipline
+  std::string poll = par("rx_queue_poll").stdstringValue();
+  if (poll == "rr") {
+    m_poll_discipline = POLL_RR;
+  } else if (poll == "weighted") {
+    m_poll_discipline = POLL_WEIGHTED;
+  } else if (poll == "priority") {
+    m_poll_discipline = POLL_PRIORITY;
+  } else {
+    throw cRuntimeError("unknown rx queue polling discipline '%s'",
+                        poll.c_str());
+  }
+
+  // get rx queue to core mapping, weights and priorities
+  std::vector<int> rx_queue_map =
+      cStringTokenizer(par("rx_queue_map").stringValue()).asIntVector();
+  std::vector<int> rx_queue_weights =
+      cStringTokenizer(par("rx_queue_weights").stringValue()).asIntVector();
+  std::vector<int> rx_queue_priorities =
+      cStringTokenizer(par("rx_queue_priorities").stringValue()).asIntVector();
+  if ((!rx_queue_map.empty() && (rx_queue_map.size() != m_n_rx_queues)) ||
+      (!rx_queue_weights.empty() &&
+       (rx_queue_weights.size() != m_n_rx_queues)) ||
+      (!rx_queue_priorities.empty() &&
+       (rx_queue_priorities.size() != m_n_rx_queues))) {
+    throw cRuntimeError("rx queue map, weights and priorities must have one "
+                        "entry per rx queue");
+  }
+
+  // create core_t structs including self-messages for per-core event
   // notification
-  m_sigs_stats_proc_util_core = new simsignal_t[m_n_cores];
-  m_sigs_stats_queue_len = new simsignal_t[m_n_cores];
   for (uint8_t i = 0; i < m_n_cores; i++) {
     core_t core;
+    core.poll_idx = 0;
+    core.poll_credit = 0;
     core.busy = false; // initially core not busy
     // create self-message triggered when a packet is complete processed and
-    // set its type
-    core.msg_proc_done = new cMessage();
-    core.msg_proc_done->setKind(MSG_KIND_PROC_DONE);
+    // set its type. it carries the core's id
+    ProcDoneMsg *msg_proc_done = new ProcDoneMsg();
+    msg_proc_done->setKind(MSG_KIND_PROC_DONE);
+    msg_proc_done->setCoreId(i);
+    core.msg_proc_done = msg_proc_done;
+    // cores start at the highest frequency
+    core.freq_idx = m_dvfs_freqs.size() - 1;
+    core.t_ready = 0;
+    core.t_busy_start = 0;
+    core.t_busy_window = 0;
+    core.t_busy_total = 0;
+    core.energy_busy = 0.0;
+    core.t_idle_start = 0; // cores are idle from the start
+    core.t_cstate.resize(m_cstate_residency.size(), 0);
+    core.t_start = 0;
     m_cores.push_back(core);
+  }
+
+  // create rx_queue_t structs and assign the rx queues to the cores
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    rx_queue_t rx_queue;
+    rx_queue.pkts = new PacketScheduler(
+        par("scheduler"), par("scheduler_order"), par("n_traffic_classes"),
+        par("scheduler_weights"), par("scheduler_quantum"),
+        par("queue_capacity"));
+    rx_queue.core_id = rx_queue_map.empty() ? i % m_n_cores : rx_queue_map[i];
+    rx_queue.weight = rx_queue_weights.empty() ? 1 : rx_queue_weights[i];
+    rx_queue.priority =
+        rx_queue_priorities.empty() ? 0 : rx_queue_priorities[i];
+    rx_queue.n_pkts_committed = 0;
+    rx_queue.in_service = false;
+    if ((rx_queue.core_id >= m_n_cores) || (rx_queue.weight == 0)) {
+      throw cRuntimeError("invalid core or weight for rx queue %d", i);
+    }
+    m_rx_queues.push_back(rx_queue);
+    m_cores[rx_queue.core_id].rx_queues.push_back(i);
+  }
 
+  // register signals for stats collection (per-core utilization, per-rx queue
+  // lengths)
+  m_sigs_stats_proc_util_core = new simsignal_t[m_n_cores];
+  m_sigs_stats_queue_len = new simsignal_t[m_n_rx_queues];
+  for (uint8_t i = 0; i < m_n_cores; i++) {
     // per-core utilization
     char signal_name[32];
     char stats_name[32];
@@ -76,50 +245,108 @@ void Processing::initialize()
         getProperties()->get("statisticTemplate", "proc_util_core");
     getEnvir()->addResultRecorders(this, m_sigs_stats_proc_util_core[i],
                                    stats_name, statisticsTemplate);
-
-    // per-core queue length
+  }
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    // per-rx queue length
+    char signal_name[32];
+    char stats_name[32];
     sprintf(signal_name, "stats_queue_len%d", i);
     sprintf(stats_name, "queue_len%d", i);
     m_sigs_stats_queue_len[i] = registerSignal(signal_name);
-    statisticsTemplate = getProperties()->get("statisticTemplate", "queue_len");
+    cProperty *statisticsTemplate =
+        getProperties()->get("statisticTemplate", "queue_len");
     getEnvir()->addResultRecorders(this, m_sigs_stats_queue_len[i], stats_name,
                                    statisticsTemplate);
   }
 
-  // initially no core is busy
+  // serve a core's whole backlog in one pass? the cores' speed must not change
+  // while the backlog is served
+  m_enabled_lazy_service = par("lazy_service");
+  if (m_enabled_lazy_service && (m_enabled_contention || m_smt_siblings ||
+                                 m_enabled_dvfs || m_enabled_cstates)) {
+    throw cRuntimeError("lazy service does not support contention, smt, dvfs "
+                        "or sleep states");
+  }
+
+  // a backlog is served in arrival order. packets arriving later must not be
+  // entitled to overtake it, neither by their traffic class, by their queue
+  // order nor by the core's polling discipline
+  if (m_enabled_lazy_service) {
+    if ((par("scheduler").stdstringValue() != "fifo") ||
+        (par("scheduler_order").stdstringValue() != "fifo")) {
+      throw cRuntimeError("lazy service requires fifo scheduling and order");
+    }
+    if (m_poll_discipline != POLL_RR) {
+      throw cRuntimeError("lazy service requires round robin polling");
+    }
+    for (uint8_t i = 0; i < m_n_cores; i++) {
+      if (m_cores[i].rx_queues.size() > 1) {
+        throw cRuntimeError("lazy service requires one rx queue per core");
+      }
+    }
+  }
+  m_queue_capacity = par("queue_capacity");
+
+  // initially no core is busy and no packets are waiting to be processed
   m_n_cores_busy = 0;
+  m_n_pkts_queued = 0;
+
+  // queue lengths are reported to the offload trigger, which is only connected
+  // if offloading is enabled. on the fast path, they are reported by a direct
+  // call instead of a message
+  m_enabled_offload_trigger = gate("trigger_out")->isConnected();
+  m_module_offload_trigger = NULL;
+  if (m_enabled_offload_trigger && par("enable_fast_path").boolValue()) {
+    m_module_offload_trigger = (OffloadTrigger *)gate("trigger_out")
+                                   ->getPathEndGate()
+                                   ->getOwnerModule();
+  }
 
-  // get pointer on offload trigger module
-  m_module_offload_trigger =
-      (OffloadTrigger *)getModuleByPath("^.offload_trigger");
-  ASSERT(m_module_offload_trigger);
+  // get pointer on flow control module
+  m_module_flow_control = (FlowControl *)getModuleByPath("^.flow_control");
+  ASSERT(m_module_flow_control);
+
+  // lazily served packets are only dequeued once the backlog is materialized,
+  // which would delay resuming the link or returning credits to the switch
+  if (m_enabled_lazy_service &&
+      (FlowControl::parse_mode(m_module_flow_control->par("mode")) !=
+       FlowControl::FC_NONE)) {
+    throw cRuntimeError("lazy service does not support flow control");
+  }
+
+  // on the fast path, processed packets are handed over to the output buffer
+  // by a direct call instead of a message
+  m_module_out_buffer = NULL;
+  if (par("enable_fast_path").boolValue()) {
+    m_module_out_buffer =
+        (OutputBuffer *)gate("out")->getPathEndGate()->getOwnerModule();
+  }
+
+  // create and schedule the periodic frequency governor event
+  m_msg_dvfs_tick = new cMessage();
+  m_msg_dvfs_tick->setKind(MSG_KIND_DVFS_TICK);
+  if (m_enabled_dvfs) {
+    scheduleAt(simTime() + m_dvfs_window, m_msg_dvfs_tick);
+  }
 }
 
 void Processing::handleMessage(cMessage *msg)
 {
+  PROFILE_HANDLE_MESSAGE("Processing");
+
   if (msg->isSelfMessage() == false) {
     // new packet arriving
     ASSERT(msg->getKind() == MSG_KIND_PACKET_DATA);
-    Packet *pkt = (Packet *)msg;
-
-    // get node context
-    PacketNodeContext *ctx = pkt->get_node_ctx();
-
-    // obtain target rx queue/core id from node context
-    uint8_t core_id = ctx->get_rx_queue();
+    handle_pkt((Packet *)msg);
+  } else if (msg->getKind() == MSG_KIND_DVFS_TICK) {
+    // governor window has elapsed. update core frequencies
+    run_dvfs_governor();
 
-    // insert packet into correct rx queue
-    m_cores[core_id].rx_queue.insert(pkt);
-
-    // emit queue length statistics
-    emit(m_sigs_stats_queue_len[core_id],
-         m_cores[core_id].rx_queue.getLength());
-
-    if (is_busy(core_id) == false) {
-      // target core has been idle. set it active now and start processing the
-      // packet we just received
-      set_busy(core_id, true);
-      process_packet(core_id);
+    // schedule next governor window. once all cores are idle and all queues
+    // are empty, the governor pauses until the next packet arrives, so that
+    // the simulation ends when the trace has been drained
+    if ((m_n_cores_busy > 0) || (m_n_pkts_queued > 0)) {
+      scheduleAt(simTime() + m_dvfs_window, m_msg_dvfs_tick);
     }
   } else {
     // this is a self-message signaling that a packet has been completely
@@ -132,23 +359,44 @@ void Processing::handleMessage(cMessage *msg)
     // self-message
     Packet *pkt = (Packet *)msg->getContextPointer();
 
-    // get packet's node context
-    PacketNodeContext *ctx = pkt->get_node_ctx();
-
-    // obtain id of the core where the packet has been processed
-    uint8_t core_id = ctx->get_rx_queue();
+    // get the core where the packet has been processed. since rx queues may be
+    // moved between cores, it cannot be derived from the packet's rx queue
+    uint8_t core_id = ((ProcDoneMsg *)msg)->getCoreId();
+    ASSERT(core_id < m_n_cores);
+    ASSERT(m_cores[core_id].msg_proc_done == msg);
+    ASSERT(is_busy(core_id));
 
-    // get core struct
-    core_t &core = m_cores[core_id];
+    if (m_enabled_lazy_service) {
+      // the core's backlog has been served. catch up on the queue state
+      // changes and serve the packets that arrived in the meantime
+      materialize_backlog(core_id);
+      ASSERT(m_cores[core_id].backlog.empty());
+      if (has_pkts(core_id)) {
+        serve_backlog(core_id);
+      } else {
+        set_busy(core_id, false);
+      }
+      return;
+    }
 
-    // do some error checking
-    ASSERT(msg == core.msg_proc_done);
-    ASSERT(is_busy(core_id));
+    // packet has left the local processing path
+    uint8_t rx_queue = pkt->get_node_ctx()->get_rx_queue();
+    ASSERT(m_rx_queues[rx_queue].in_service);
+    m_rx_queues[rx_queue].in_service = false;
+    pkt->get_node_ctx()->release_in_flight_cntr();
 
     // send out the packet
     send_pkt(pkt);
 
-    if (core.rx_queue.isEmpty() == false) {
+    // if the rx queue has been moved to another core while the packet was
+    // being processed, the new core may take over its waiting packets now
+    uint8_t core_id_new = get_rx_queue_core(rx_queue);
+    if ((core_id_new != core_id) && (is_busy(core_id_new) == false) &&
+        (m_rx_queues[rx_queue].pkts->is_empty() == false)) {
+      start_core(core_id_new);
+    }
+
+    if (has_pkts(core_id)) {
       // there are more packets waiting to be processed on this core. trigger
       // processing of next one
       process_packet(core_id);
@@ -159,6 +407,130 @@ void Processing::handleMessage(cMessage *msg)
   }
 }
 
+void Processing::receive_pkt(Packet *pkt)
+{
+  // packet handed over by the offload module on the fast path
+  Enter_Method_Silent();
+  take(pkt);
+  handle_pkt(pkt);
+}
+
+void Processing::handle_pkt(Packet *pkt)
+{
+  // get node context
+  PacketNodeContext *ctx = pkt->get_node_ctx();
+
+  // catch up on the queue state changes of lazily served packets
+  sync_backlogs();
+
+  // obtain target rx queue id from node context and look up the core polling
+  // it
+  uint8_t rx_queue = ctx->get_rx_queue();
+  uint8_t core_id = get_rx_queue_core(rx_queue);
+
+  // resume the frequency governor if it has been paused while the node was
+  // idle
+  if (m_enabled_dvfs && (m_msg_dvfs_tick->isScheduled() == false)) {
+    scheduleAt(simTime() + m_dvfs_window, m_msg_dvfs_tick);
+  }
+
+  // packet has been accepted from the link
+  m_module_flow_control->report_pkt_enqueued();
+
+  // insert packet into correct rx queue. if the queue is full, the packet is
+  // dropped. lazily served packets whose service has not started yet still
+  // occupy the queue
+  if ((m_enabled_lazy_service && (m_queue_capacity > 0) &&
+       (get_queue_len(rx_queue) >= m_queue_capacity)) ||
+      (m_rx_queues[rx_queue].pkts->insert(pkt) == false)) {
+    drop_pkt(pkt, m_rx_queues[rx_queue].pkts);
+    return;
+  }
+  m_n_pkts_queued++;
+
+  // emit queue length statistics
+  if (STATS_DETAILED) {
+    emit(m_sigs_stats_queue_len[rx_queue], get_queue_len(rx_queue));
+  }
+
+  if ((is_busy(core_id) == false) && has_pkts(core_id)) {
+    // target core has been idle. set it active now and start processing the
+    // packet we just received. if the rx queue has just been moved to the
+    // core and its previous packet is still in service on the old core, the
+    // core is started once that packet is done
+    start_core(core_id);
+  }
+}
+
+void Processing::start_core(uint8_t core_id)
+{
+  // set idle core active and start processing its packets
+  set_busy(core_id, true);
+  if (m_enabled_lazy_service) {
+    serve_backlog(core_id);
+  } else {
+    process_packet(core_id);
+  }
+}
+
+void Processing::serve_backlog(uint8_t core_id)
+{
+  // serve all packets waiting for the core back to back. their service times
+  // are precomputed and a single event is scheduled when the last one is
+  // done. packets arriving in the meantime are served afterwards
+  core_t &core = m_cores[core_id];
+  core.t_start = simTime();
+  while (has_pkts(core_id)) {
+    process_packet(core_id);
+  }
+  core.msg_proc_done->setContextPointer(NULL);
+  scheduleAt(core.t_start, core.msg_proc_done);
+}
+
+void Processing::materialize_backlog(uint8_t core_id)
+{
+  core_t &core = m_cores[core_id];
+  while (!core.backlog.empty() && (core.backlog.front().t_start <= simTime())) {
+    backlog_entry_t &entry = core.backlog.front();
+
+    if (!entry.started) {
+      // service of the packet has started. report the queue length it has
+      // seen and remove it from the queue
+      report_queue_len(entry.rx_queue, get_queue_len(entry.rx_queue));
+      ASSERT(m_rx_queues[entry.rx_queue].n_pkts_committed > 0);
+      m_rx_queues[entry.rx_queue].n_pkts_committed--;
+      ASSERT(m_n_pkts_queued > 0);
+      m_n_pkts_queued--;
+      m_module_flow_control->report_pkt_dequeued();
+      entry.started = true;
+    }
+
+    if (entry.t_end > simTime()) {
+      break;
+    }
+
+    // packet has left the local processing path
+    if (entry.in_flight_cntr) {
+      ASSERT(*entry.in_flight_cntr > 0);
+      (*entry.in_flight_cntr)--;
+    }
+    core.backlog.pop_front();
+  }
+}
+
+void Processing::sync_backlogs()
+{
+  Enter_Method_Silent();
+
+  // materialize the queue state changes of the lazily served packets up to
+  // the current time
+  if (m_enabled_lazy_service) {
+    for (uint8_t i = 0; i < m_n_cores; i++) {
+      materialize_backlog(i);
+    }
+  }
+}
+
 Packet *Processing::process_packet(uint8_t core_id)
 {
   ASSERT(is_busy(core_id));
@@ -166,29 +538,85 @@ Packet *Processing::process_packet(uint8_t core_id)
   // get core
   core_t &core = m_cores[core_id];
 
-  // report queue length
-  m_module_offload_trigger->report_queue_len(core_id, get_queue_len(core_id));
+  // select the rx queue to serve next according to the polling discipline
+  int16_t rx_queue = select_rx_queue(core_id);
+  ASSERT(rx_queue >= 0);
 
-  // get rx queue
-  cPacketQueue &rx_queue = core.rx_queue;
-  ASSERT(rx_queue.isEmpty() == false);
+  // pop packet from rx queue. with lazy service, the packet's service may
+  // start later. the queue length is reported once it starts
+  Packet *pkt;
+  if (m_enabled_lazy_service) {
+    pkt = (Packet *)m_rx_queues[rx_queue].pkts->pop();
+    m_rx_queues[rx_queue].n_pkts_committed++;
+  } else {
+    // service starts now
+    core.t_start = simTime();
+
+    // report queue length
+    report_queue_len(rx_queue, get_queue_len(rx_queue));
 
-  // pop packet from rx queue
-  Packet *pkt = (Packet *)rx_queue.pop();
+    pkt = (Packet *)m_rx_queues[rx_queue].pkts->pop();
+    ASSERT(m_n_pkts_queued > 0);
+    m_n_pkts_queued--;
+    m_module_flow_control->report_pkt_dequeued();
+
+    // the queue's next packets must not overtake this one, even if the queue
+    // is moved to another core
+    m_rx_queues[rx_queue].in_service = true;
+  }
 
   // get number of instructions to execute on this packet
   uint32_t instr = pkt->get_instr();
   ASSERT(instr > 0);
 
+  // the instruction time depends on how many cores are competing for shared
+  // resources. it is determined when processing starts and not updated while
+  // the packet is being processed
+  if (m_enabled_contention || m_smt_siblings || m_enabled_dvfs) {
+    double slowdown = 1.0;
+    if (m_enabled_contention || m_smt_siblings) {
+      slowdown = calc_contention_slowdown(core_id);
+      if (STATS_DETAILED) {
+        emit(m_sig_stats_contention_slowdown, slowdown);
+      }
+    }
+    double freq = m_dvfs_freqs[core.freq_idx];
+    set_t_inst(core_id, m_t_inst_base * slowdown / freq);
+  }
+
   // calculate the time required to execute the IPPs
-  simtime_t t_proc = instr * m_t_inst[core_id];
+  simtime_t t_exec = instr * m_t_inst[core_id];
+
+  // if the core is still switching its frequency or waking up from a sleep
+  // state, processing is stalled until it is ready
+  simtime_t t_stall = 0;
+  if (core.t_ready > simTime()) {
+    t_stall = core.t_ready - simTime();
+  }
+  simtime_t t_proc = t_stall + t_exec;
+
+  // account the energy consumed for executing the IPPs. stalled time is
+  // charged as idle time
+  core.t_busy_total += t_exec;
+  m_n_pkts_processed++;
+  m_n_instr_processed += instr;
+  if (m_enabled_energy) {
+    double energy =
+        calc_power_busy(m_dvfs_freqs[core.freq_idx]) * SIMTIME_DBL(t_exec);
+    core.energy_busy += energy;
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_energy_pkt, energy);
+    }
+  }
 
   // report IPP statistics
-  emit(m_sig_stats_ipp, instr);
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_ipp, instr);
+  }
 
   // calculate the duration that the packet has been waiting in the input
   // buffer
-  simtime_t t_buffer = simTime() - pkt->getArrivalTime();
+  simtime_t t_buffer = core.t_start - pkt->getArrivalTime();
 
   // get packet's latency object
   Latency *latency = pkt->get_latency();
@@ -203,22 +631,58 @@ Packet *Processing::process_packet(uint8_t core_id)
       new LatencyElement(LatencyElement::NODE_PROC, t_proc);
   latency->add_element(latency_proc);
 
+  // mark packet as being processed
+  pkt->set_processing_done();
+
+  if (m_enabled_lazy_service) {
+    // add the packet to the core's backlog and send it out once its
+    // processing is completed. the next packet's service starts then
+    backlog_entry_t entry;
+    entry.t_start = core.t_start;
+    entry.t_end = core.t_start + t_proc;
+    entry.rx_queue = rx_queue;
+    entry.started = false;
+    entry.in_flight_cntr = pkt->get_node_ctx()->detach_in_flight_cntr();
+    core.backlog.push_back(entry);
+    core.t_start = entry.t_end;
+    pkt->setSchedulingPriority(MSG_PRIORITY_DEFAULT);
+    sendDelayed(pkt, entry.t_end - simTime(), "out");
+    return pkt;
+  }
+
   // schedule self-message to be sent after processing is completed. pass along
   // a pointer to the packet as context
   core.msg_proc_done->setContextPointer(pkt);
   scheduleAt(simTime() + t_proc, core.msg_proc_done);
 
-  // mark packet as being processed
-  pkt->set_processing_done();
-
   // return the packet that is being processed
   return pkt;
 }
 
 void Processing::set_busy(uint8_t core_id, bool busy)
 {
+  // get core
+  core_t &core = m_cores[core_id];
+
   // save core busy/idle state
-  m_cores[core_id].busy = busy;
+  core.busy = busy;
+
+  // maintain busy time within the current governor window
+  if (busy) {
+    core.t_busy_start = simTime();
+  } else {
+    core.t_busy_window += simTime() - core.t_busy_start;
+  }
+
+  // a core becoming busy leaves its sleep state. a core becoming idle starts
+  // its idle period
+  if (busy) {
+    if (m_enabled_cstates) {
+      wake_core(core_id);
+    }
+  } else {
+    core.t_idle_start = simTime();
+  }
 
   // maintain number of currently busy cores
   if (busy) {
@@ -230,14 +694,54 @@ void Processing::set_busy(uint8_t core_id, bool busy)
   }
 
   // report utilization statistics
-  emit(m_sigs_stats_proc_util_core[core_id], busy);
-  emit(m_sig_stats_proc_util, m_n_cores_busy);
+  if (STATS_DETAILED) {
+    emit(m_sigs_stats_proc_util_core[core_id], busy);
+    emit(m_sig_stats_proc_util, m_n_cores_busy);
+  }
 }
 
 void Processing::send_pkt(Packet *pkt)
 {
-  // send packet out
-  send(pkt, "out");
+  // send packet out. on the fast path, it is handed over to the output buffer
+  // directly
+  if (m_module_out_buffer) {
+    m_module_out_buffer->receive_pkt(pkt);
+  } else {
+    pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(pkt, "out");
+  }
+}
+
+void Processing::report_queue_len(uint8_t rx_queue, uint32_t queue_len)
+{
+  if (m_module_offload_trigger) {
+    m_module_offload_trigger->report_queue_len(rx_queue, queue_len);
+  } else if (m_enabled_offload_trigger) {
+    QueueLenMsg *msg = new QueueLenMsg;
+    msg->setKind(MSG_KIND_QUEUE_LEN);
+    msg->setQueueId(rx_queue);
+    msg->setQueueLen(queue_len);
+    msg->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(msg, "trigger_out");
+  }
+}
+
+void Processing::drop_pkt(Packet *pkt, PacketScheduler *pkts)
+{
+  // report traffic class of the dropped packet
+  emit(m_sig_stats_drop_class, pkts->get_traffic_class(pkt));
+
+  // packet leaves the local and offloading paths. the tor switch routes the
+  // release of offloaded packets to the nodes they have passed
+  pkt->get_node_ctx()->release_in_flight_cntr();
+  if (pkt->has_in_flight_refs()) {
+    send(pkt->create_in_flight_release(), "release_out");
+  }
+
+  // its slot in the rx queues is free again
+  m_module_flow_control->report_pkt_dequeued();
+
+  delete pkt;
 }
 
 bool Processing::is_busy(uint8_t core_id)
@@ -246,11 +750,23 @@ bool Processing::is_busy(uint8_t core_id)
   return m_cores[core_id].busy;
 }
 
-uint32_t Processing::get_queue_len(uint8_t core_id)
+uint32_t Processing::get_queue_len(uint8_t rx_queue)
 {
+  // return the number of packets that are currently waiting in the specified
+  // rx queue. this includes lazily served packets whose service has not
+  // started yet
+  return m_rx_queues[rx_queue].pkts->get_length() +
+         m_rx_queues[rx_queue].n_pkts_committed;
+}
+
+uint32_t Processing::get_total_queue_len()
+{
+  // catch up on the queue state changes of lazily served packets
+  sync_backlogs();
+
   // return the number of packets that are currently waiting to be processed
-  // by the specified CPU core.
-  return (uint32_t)m_cores[core_id].rx_queue.getLength();
+  // on any of the CPU cores
+  return m_n_pkts_queued;
 }
 
 void Processing::set_t_inst(uint8_t core_id, simtime_t t_inst)
@@ -258,3 +774,354 @@ void Processing::set_t_inst(uint8_t core_id, simtime_t t_inst)
   // that the time the core takes to complete one instruction
   m_t_inst[core_id] = t_inst;
 }
+
+double Processing::calc_contention_slowdown(uint8_t core_id)
+{
+  double slowdown = 1.0;
+
+  // shared last-level cache and memory bandwidth
+  if (m_enabled_contention) {
+    ASSERT(m_n_cores_busy > 0);
+    size_t idx = m_n_cores_busy - 1;
+    if (idx >= m_contention_slowdown.size()) {
+      idx = m_contention_slowdown.size() - 1;
+    }
+    slowdown *= m_contention_slowdown[idx];
+  }
+
+  // execution units shared with the smt sibling
+  if (m_smt_siblings) {
+    uint8_t sibling_id = core_id ^ 1;
+    if ((sibling_id < m_n_cores) && is_busy(sibling_id)) {
+      slowdown *= m_smt_slowdown;
+    }
+  }
+
+  return slowdown;
+}
+
+void Processing::run_dvfs_governor()
+{
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    // get core
+    core_t &core = m_cores[i];
+
+    // close busy period at window boundary
+    if (core.busy) {
+      core.t_busy_window += simTime() - core.t_busy_start;
+      core.t_busy_start = simTime();
+    }
+
+    // calculate utilization within the elapsed window and reset it
+    double util = core.t_busy_window / m_dvfs_window;
+    if (util > 1.0) {
+      util = 1.0;
+    }
+    core.t_busy_window = 0;
+
+    // select new frequency state
+    uint8_t freq_idx = calc_dvfs_freq_idx(i, util);
+    if (freq_idx != core.freq_idx) {
+      // switch frequency. the core cannot execute instructions until the
+      // switch is complete
+      core.freq_idx = freq_idx;
+      core.t_ready = simTime() + m_dvfs_transition_latency;
+      emit(m_sig_stats_dvfs_transition, m_dvfs_freqs[freq_idx]);
+    }
+
+    // report frequency statistics
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_dvfs_freq, m_dvfs_freqs[core.freq_idx]);
+    }
+  }
+}
+
+uint8_t Processing::calc_dvfs_freq_idx(uint8_t core_id, double util)
+{
+  uint8_t idx_max = m_dvfs_freqs.size() - 1;
+  double freq = m_dvfs_freqs[m_cores[core_id].freq_idx];
+
+  // calculate target frequency
+  double freq_target;
+  if (m_dvfs_governor_schedutil) {
+    // schedutil: frequency proportional to the frequency-invariant
+    // utilization plus 25% headroom
+    freq_target = 1.25 * freq * util;
+  } else {
+    // ondemand: jump to the highest frequency if utilization exceeds the
+    // threshold. otherwise scale down such that utilization would just reach
+    // the threshold
+    if (util > m_dvfs_up_threshold) {
+      return idx_max;
+    }
+    freq_target = freq * util / m_dvfs_up_threshold;
+  }
+
+  // pick the lowest frequency state satisfying the target
+  for (uint8_t i = 0; i < idx_max; i++) {
+    if (m_dvfs_freqs[i] >= freq_target) {
+      return i;
+    }
+  }
+  return idx_max;
+}
+
+double Processing::calc_power_busy(double freq)
+{
+  // dynamic power scales with the cube of the frequency (voltage scaled
+  // proportionally)
+  return m_power_static + m_power_dynamic * freq * freq * freq;
+}
+
+void Processing::finish()
+{
+  // aggregate statistics, recorded at every statistics level. utilization is
+  // the fraction of time the cores spent executing instructions
+  simtime_t t_busy_total = 0;
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    t_busy_total += m_cores[i].t_busy_total;
+  }
+  recordScalar("n_pkts_processed", m_n_pkts_processed);
+  if (m_n_pkts_processed > 0) {
+    recordScalar("ipp_mean", (double)m_n_instr_processed / m_n_pkts_processed);
+  }
+  if (simTime() > 0) {
+    recordScalar("proc_util_mean", t_busy_total / (simTime() * m_n_cores));
+  }
+
+  // account sleep state residency of cores that are still idle
+  if (m_enabled_cstates) {
+    for (uint8_t i = 0; i < m_n_cores; i++) {
+      if (is_busy(i) == false) {
+        account_cstate_residency(i);
+        m_cores[i].t_idle_start = simTime();
+      }
+    }
+
+    // record fraction of time the cores spent in each sleep state
+    for (size_t j = 0; j < m_cstate_residency.size(); j++) {
+      simtime_t t_cstate = 0;
+      for (uint8_t i = 0; i < m_n_cores; i++) {
+        t_cstate += m_cores[i].t_cstate[j];
+      }
+
+      char scalar_name[32];
+      sprintf(scalar_name, "cstate%d_residency", (int)j);
+      recordScalar(scalar_name, t_cstate / (simTime() * m_n_cores));
+    }
+  }
+
+  if (m_enabled_energy == false) {
+    return;
+  }
+
+  // total energy consumed by all cores. cores consume idle power whenever they
+  // are not executing instructions, or the power of the sleep state they are
+  // in
+  double energy_total = 0.0;
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    core_t &core = m_cores[i];
+    double t_idle = SIMTIME_DBL(simTime() - core.t_busy_total);
+    double energy = core.energy_busy;
+    for (size_t j = 0; j < core.t_cstate.size(); j++) {
+      double t_cstate = SIMTIME_DBL(core.t_cstate[j]);
+      double power = m_cstate_power.empty() ? m_power_idle : m_cstate_power[j];
+      energy += power * t_cstate;
+      t_idle -= t_cstate;
+    }
+    energy += m_power_idle * t_idle;
+
+    char scalar_name[32];
+    sprintf(scalar_name, "energy_core%d", i);
+    recordScalar(scalar_name, energy);
+
+    energy_total += energy;
+  }
+
+  // record total energy and energy per processed packet
+  recordScalar("energy_total", energy_total);
+  if (m_n_pkts_processed > 0) {
+    recordScalar("energy_per_pkt", energy_total / m_n_pkts_processed);
+  }
+}
+
+void Processing::wake_core(uint8_t core_id)
+{
+  // get core
+  core_t &core = m_cores[core_id];
+
+  // account the idle period that just ended and determine the sleep state the
+  // core has reached
+  int cstate = account_cstate_residency(core_id);
+  if (cstate < 0) {
+    // idle period too short to enter any sleep state
+    return;
+  }
+
+  // the core cannot execute instructions before it has left the sleep state
+  simtime_t t_ready = simTime() + m_cstate_exit_latency[cstate];
+  if (t_ready > core.t_ready) {
+    core.t_ready = t_ready;
+  }
+
+  // report sleep state statistics
+  if (STATS_DETAILED) {
+    emit(m_sig_stats_cstate, cstate);
+    emit(m_sig_stats_cstate_exit_latency, m_cstate_exit_latency[cstate]);
+  }
+}
+
+int Processing::account_cstate_residency(uint8_t core_id)
+{
+  // get core
+  core_t &core = m_cores[core_id];
+
+  // duration of the current idle period
+  simtime_t t_idle = simTime() - core.t_idle_start;
+
+  // walk through the sleep states. the core enters state i once it has been
+  // idle for the state's residency threshold and stays there until it enters
+  // the next deeper state or wakes up
+  int cstate = -1;
+  size_t n_cstates = m_cstate_residency.size();
+  for (size_t i = 0; i < n_cstates; i++) {
+    if (t_idle <= m_cstate_residency[i]) {
+      break;
+    }
+    simtime_t t_leave = t_idle;
+    if ((i + 1 < n_cstates) && (m_cstate_residency[i + 1] < t_leave)) {
+      t_leave = m_cstate_residency[i + 1];
+    }
+    core.t_cstate[i] += t_leave - m_cstate_residency[i];
+    cstate = i;
+  }
+
+  return cstate;
+}
+
+int16_t Processing::select_rx_queue(uint8_t core_id)
+{
+  // get core
+  core_t &core = m_cores[core_id];
+  size_t n_rx_queues = core.rx_queues.size();
+
+  // core does not poll any rx queue
+  if (n_rx_queues == 0) {
+    return -1;
+  }
+
+  if (m_poll_discipline == POLL_PRIORITY) {
+    // serve the non-empty rx queue with the highest priority. on ties, the
+    // queue assigned first to the core wins
+    int16_t rx_queue_selected = -1;
+    for (size_t i = 0; i < n_rx_queues; i++) {
+      uint8_t rx_queue = core.rx_queues[i];
+      if (m_rx_queues[rx_queue].pkts->is_empty() ||
+          m_rx_queues[rx_queue].in_service) {
+        continue;
+      }
+      if ((rx_queue_selected < 0) ||
+          (m_rx_queues[rx_queue].priority >
+           m_rx_queues[rx_queue_selected].priority)) {
+        rx_queue_selected = rx_queue;
+      }
+    }
+    return rx_queue_selected;
+  }
+
+  // round robin over the core's rx queues. with weighted polling, the
+  // currently polled queue is served until it runs empty or its credit is
+  // exhausted. the currently polled queue is visited a second time at the end
+  // of the round, then with a fresh credit
+  for (size_t i = 0; i <= n_rx_queues; i++) {
+    size_t idx = (core.poll_idx + i) % n_rx_queues;
+    rx_queue_t &rx_queue = m_rx_queues[core.rx_queues[idx]];
+
+    // entering a new rx queue refreshes the credit
+    if ((i > 0) || (m_poll_discipline == POLL_RR)) {
+      core.poll_credit = (m_poll_discipline == POLL_RR) ? 1 : rx_queue.weight;
+    }
+
+    if (rx_queue.pkts->is_empty() || rx_queue.in_service ||
+        (core.poll_credit == 0)) {
+      continue;
+    }
+
+    // serve this rx queue. with round robin polling, continue with the next
+    // queue next time
+    core.poll_credit--;
+    core.poll_idx = idx;
+    if (m_poll_discipline == POLL_RR) {
+      core.poll_idx = (idx + 1) % n_rx_queues;
+    }
+    return core.rx_queues[idx];
+  }
+
+  // all rx queues are empty
+  return -1;
+}
+
+bool Processing::has_pkts(uint8_t core_id)
+{
+  // return whether there are packets waiting in any of the core's rx queues.
+  // queues whose previous packet is still processed on another core are not
+  // served yet
+  core_t &core = m_cores[core_id];
+  for (size_t i = 0; i < core.rx_queues.size(); i++) {
+    rx_queue_t &rx_queue = m_rx_queues[core.rx_queues[i]];
+    if ((rx_queue.pkts->is_empty() == false) && !rx_queue.in_service) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t Processing::get_rx_queue_core(uint8_t rx_queue)
+{
+  // return the core that is polling the specified rx queue
+  ASSERT(rx_queue < m_n_rx_queues);
+  return m_rx_queues[rx_queue].core_id;
+}
+
+uint8_t Processing::get_n_rx_queues_core(uint8_t core_id)
+{
+  // return the number of rx queues polled by the specified core
+  return (uint8_t)m_cores[core_id].rx_queues.size();
+}
+
+void Processing::move_rx_queue(uint8_t rx_queue, uint8_t core_id)
+{
+  ASSERT(core_id < m_n_cores);
+
+  // get current core of the rx queue
+  uint8_t core_id_old = get_rx_queue_core(rx_queue);
+  if (core_id_old == core_id) {
+    return;
+  }
+
+  // remove rx queue from the old core
+  core_t &core_old = m_cores[core_id_old];
+  for (size_t i = 0; i < core_old.rx_queues.size(); i++) {
+    if (core_old.rx_queues[i] == rx_queue) {
+      core_old.rx_queues.erase(core_old.rx_queues.begin() + i);
+      break;
+    }
+  }
+  if (core_old.poll_idx >= core_old.rx_queues.size()) {
+    core_old.poll_idx = 0;
+  }
+
+  // add rx queue to the new core. packets that are already waiting in the
+  // queue move along with it
+  m_cores[core_id].rx_queues.push_back(rx_queue);
+  m_rx_queues[rx_queue].core_id = core_id;
+
+  // if the new core has been idle, it starts working on the queue's packets.
+  // if the old core is still processing a packet of the queue, the new core
+  // waits for it to complete, so that the packet is not overtaken
+  if ((is_busy(core_id) == false) &&
+      (m_rx_queues[rx_queue].in_service == false) &&
+      (m_rx_queues[rx_queue].pkts->is_empty() == false)) {
+    start_core(core_id);
+  }
+}
@@ -1,48 +1,151 @@
 #ifndef MODULES_NODE_PROCESSING_H_
 #define MODULES_NODE_PROCESSING_H_
 
+#include "IProcessing.h"
+#include <deque>
 #include <omnetpp.h>
 
 using namespace omnetpp;
 
+class FlowControl;
 class OffloadTrigger;
+class OutputBuffer;
 class Packet;
+class PacketScheduler;
 
-class Processing : public cSimpleModule
+class Processing : public cSimpleModule, public IProcessing
 {
 public:
   virtual ~Processing();
 
+  virtual uint32_t get_total_queue_len() override;
+  void receive_pkt(Packet *pkt);
+  void sync_backlogs();
+
 protected:
   virtual void initialize();
   virtual void handleMessage(cMessage *msg);
+  virtual void finish();
   virtual Packet *process_packet(uint8_t core_id);
+  uint8_t get_rx_queue_core(uint8_t rx_queue);
+  void move_rx_queue(uint8_t rx_queue, uint8_t core_id);
+  uint8_t get_n_rx_queues_core(uint8_t core_id);
 
   uint8_t m_n_cores;
+  uint8_t m_n_rx_queues;
+  simtime_t m_t_inst_base;
 
 private:
+  typedef enum { POLL_RR, POLL_WEIGHTED, POLL_PRIORITY } poll_discipline_t;
+
+  typedef struct {
+    PacketScheduler *pkts; // packets waiting in the rx queue
+    uint8_t core_id;       // core polling the rx queue
+    uint32_t weight;       // packets served per round (weighted polling)
+    int priority;          // queue priority (priority polling)
+    // lazy service: packets popped, but whose service has not started yet
+    uint32_t n_pkts_committed;
+    bool in_service; // a packet of the queue is being processed
+  } rx_queue_t;
+
+  typedef struct {
+    simtime_t t_start;        // service start
+    simtime_t t_end;          // service end
+    uint8_t rx_queue;         // rx queue the packet has been popped from
+    bool started;             // queue state at service start materialized?
+    uint32_t *in_flight_cntr; // released at service end
+  } backlog_entry_t;
+
   typedef struct {
-    cPacketQueue rx_queue; // packet rx queue assigned to this core
-    bool busy;             // core busy?
+    std::vector<uint8_t> rx_queues; // rx queues polled by this core
+    size_t poll_idx;                // rx queue currently polled
+    uint32_t poll_credit;           // packets left to serve from rx queue
+    bool busy;                      // core busy?
     // message scheduled when processing of packet is done
     cMessage *msg_proc_done;
+    uint8_t freq_idx;        // index of the current frequency state
+    simtime_t t_ready;       // time when a frequency switch/wake-up completes
+    simtime_t t_busy_start;  // start of current busy period within window
+    simtime_t t_busy_window; // busy time within current governor window
+    simtime_t t_busy_total;  // total time spent executing instructions
+    double energy_busy;      // energy consumed while executing (joules)
+    simtime_t t_idle_start;  // time when the core became idle
+    std::vector<simtime_t> t_cstate; // time spent in each sleep state
+    simtime_t t_start; // service start of the packet being processed
+    std::deque<backlog_entry_t> backlog; // lazily served packets
   } core_t;
 
+  void handle_pkt(Packet *pkt);
+  void start_core(uint8_t core_id);
+  void serve_backlog(uint8_t core_id);
+  void materialize_backlog(uint8_t core_id);
+  int16_t select_rx_queue(uint8_t core_id);
+  bool has_pkts(uint8_t core_id);
   void set_t_inst(uint8_t core_id, simtime_t t_inst);
+  double calc_contention_slowdown(uint8_t core_id);
+  void run_dvfs_governor();
+  uint8_t calc_dvfs_freq_idx(uint8_t core_id, double util);
+  double calc_power_busy(double freq);
+  void wake_core(uint8_t core_id);
+  int account_cstate_residency(uint8_t core_id);
+  void report_queue_len(uint8_t rx_queue, uint32_t queue_len);
   void send_pkt(Packet *pkt);
+  void drop_pkt(Packet *pkt, PacketScheduler *pkts);
   void set_busy(uint8_t core_id, bool busy);
   bool is_busy(uint8_t core_id);
-  uint32_t get_queue_len(uint8_t core_id);
+  uint32_t get_queue_len(uint8_t rx_queue);
 
   simtime_t *m_t_inst;
 
+  bool m_enabled_contention;
+  std::vector<double> m_contention_slowdown;
+  bool m_smt_siblings;
+  double m_smt_slowdown;
+
+  bool m_enabled_dvfs;
+  std::vector<double> m_dvfs_freqs;
+  bool m_dvfs_governor_schedutil;
+  simtime_t m_dvfs_window;
+  double m_dvfs_up_threshold;
+  simtime_t m_dvfs_transition_latency;
+  cMessage *m_msg_dvfs_tick;
+
+  bool m_enabled_energy;
+  double m_power_static;
+  double m_power_dynamic;
+  double m_power_idle;
+  uint64_t m_n_pkts_processed;
+  uint64_t m_n_instr_processed;
+
+  bool m_enabled_cstates;
+  std::vector<double> m_cstate_residency;
+  std::vector<double> m_cstate_exit_latency;
+  std::vector<double> m_cstate_power;
+
+  bool m_enabled_lazy_service;
+  uint32_t m_queue_capacity;
+
+  std::vector<rx_queue_t> m_rx_queues;
+  poll_discipline_t m_poll_discipline;
+
   std::vector<core_t> m_cores;
   uint8_t m_n_cores_busy;
+  uint32_t m_n_pkts_queued;
 
+  bool m_enabled_offload_trigger;
   OffloadTrigger *m_module_offload_trigger;
+  FlowControl *m_module_flow_control;
+  OutputBuffer *m_module_out_buffer;
 
   simsignal_t m_sig_stats_ipp;
   simsignal_t m_sig_stats_proc_util;
+  simsignal_t m_sig_stats_contention_slowdown;
+  simsignal_t m_sig_stats_dvfs_freq;
+  simsignal_t m_sig_stats_dvfs_transition;
+  simsignal_t m_sig_stats_energy_pkt;
+  simsignal_t m_sig_stats_cstate;
+  simsignal_t m_sig_stats_cstate_exit_latency;
+  simsignal_t m_sig_stats_drop_class;
   simsignal_t *m_sigs_stats_proc_util_core;
   simsignal_t *m_sigs_stats_queue_len;
 };
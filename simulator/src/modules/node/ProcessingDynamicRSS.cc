@@ -1,12 +1,15 @@
 #include "ProcessingDynamicRSS.h"
+#include "../../defines.h"
 #include "../../msgs/Packet.h"
-#include "Offload.h"
+#include "../../msgs/PacketNodeContext.h"
+#include "../../msgs/RetaUpdateMsg_m.h"
 
 Define_Module(ProcessingDynamicRSS)
 
     ProcessingDynamicRSS::~ProcessingDynamicRSS()
 {
   delete[] m_core_instr_cntr;
+  delete[] m_rx_queue_instr_cntr;
   delete[] m_rss_reta;
   delete[] m_rss_reta_instr_cntr;
 }
@@ -16,27 +19,67 @@ void ProcessingDynamicRSS::initialize()
   // initialize parent module
   Processing::initialize();
 
+  // lazily served packets are popped from their rx queue before their service
+  // starts. a moved queue's next packets could overtake them on the new core
+  if (par("lazy_service").boolValue()) {
+    throw cRuntimeError("lazy service does not support moving rx queues "
+                        "between cores");
+  }
+
   // initialize per-core instruction counter
   m_core_instr_cntr = new uint64_t[m_n_cores];
   for (uint8_t i = 0; i < m_n_cores; i++) {
     m_core_instr_cntr[i] = 0;
   }
 
+  // initialize per-rx queue instruction counter
+  m_rx_queue_instr_cntr = new uint64_t[m_n_rx_queues];
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    m_rx_queue_instr_cntr[i] = 0;
+  }
+
   // get parameters
   m_t_reassignment_interval = par("t_reassignment_interval");
   m_rss_reta_size = par("rss_reta_size");
+  m_enabled_balance_rx_queues = par("balance_rx_queues");
+  m_enabled_consolidation = par("enable_consolidation");
+  m_consolidation_target_util = par("consolidation_target_util");
+  ASSERT(m_consolidation_target_util > 0.0);
 
   // initialize rss reta table and per-entry instruction counters
   m_rss_reta = new uint8_t[m_rss_reta_size];
   m_rss_reta_instr_cntr = new uint64_t[m_rss_reta_size];
   for (uint16_t i = 0; i < m_rss_reta_size; i++) {
-    m_rss_reta[i] = i % m_n_cores;
+    m_rss_reta[i] = i % m_n_rx_queues;
     m_rss_reta_instr_cntr[i] = 0;
   }
 
-  // get pointer on offload module
-  m_module_offload = (Offload *)getModuleByPath("^.offload");
-  ASSERT(m_module_offload);
+  // initially all cores are active
+  m_n_active_cores = m_n_cores;
+
+  // register signal for stats collection
+  m_sig_stats_n_active_cores = registerSignal("stats_n_active_cores");
+  emit(m_sig_stats_n_active_cores, m_n_active_cores);
+}
+
+void ProcessingDynamicRSS::handleParameterChange(const char *name)
+{
+  // the rebalancing policy may be changed during the simulation (e.g. by
+  // variants warm-started from a checkpoint). it applies from the next
+  // reassignment on
+  if (strcmp(name, "t_reassignment_interval") == 0) {
+    m_t_reassignment_interval = par("t_reassignment_interval");
+  } else if (strcmp(name, "balance_rx_queues") == 0) {
+    m_enabled_balance_rx_queues = par("balance_rx_queues");
+  } else if (strcmp(name, "enable_consolidation") == 0) {
+    m_enabled_consolidation = par("enable_consolidation");
+  } else if (strcmp(name, "consolidation_target_util") == 0) {
+    m_consolidation_target_util = par("consolidation_target_util");
+    ASSERT(m_consolidation_target_util > 0.0);
+  } else {
+    throw cRuntimeError("parameter '%s' cannot be changed during simulation",
+                        name);
+  }
 }
 
 Packet *ProcessingDynamicRSS::process_packet(uint8_t core_id)
@@ -48,20 +91,42 @@ Packet *ProcessingDynamicRSS::process_packet(uint8_t core_id)
   uint32_t n_instr = pkt->get_instr();
 
   // get packets toeplitz hash value
-  uint32_t toeplitz_hash = pkt->get_flow()->get_toeplitz_hash();
+  uint32_t toeplitz_hash = pkt->get_flow().get_toeplitz_hash();
 
   // update per-core instruction counter
   m_core_instr_cntr[core_id] += n_instr;
 
+  // update per-rx queue instruction counter
+  m_rx_queue_instr_cntr[pkt->get_node_ctx()->get_rx_queue()] += n_instr;
+
   // update per-reta entry instruction counter
   m_rss_reta_instr_cntr[toeplitz_hash % m_rss_reta_size] += n_instr;
 
   // perform RSS reassignment?
   if (simTime() - m_t_last_reassignment >= m_t_reassignment_interval) {
+    simtime_t t_interval = simTime() - m_t_last_reassignment;
+
+    // save reassignment time. this is done first, because moving an rx queue
+    // may start processing on an idle core, which must not trigger another
+    // reassignment
+    m_t_last_reassignment = simTime();
+
+    // move load away from cores that are not needed at the current load. load
+    // balancing is then only performed among the active cores
+    if (m_enabled_consolidation) {
+      m_n_active_cores = calc_n_active_cores(t_interval);
+      if (m_enabled_balance_rx_queues) {
+        consolidate_rx_queues();
+      } else {
+        consolidate_reta();
+      }
+      emit(m_sig_stats_n_active_cores, m_n_active_cores);
+    }
+
     // find core with the highest and lowest loads
     uint8_t core_id_highest_load, core_id_lowest_load;
     uint64_t n_instr_max, n_instr_min;
-    for (uint8_t i = 0; i < m_n_cores; i++) {
+    for (uint8_t i = 0; i < m_n_active_cores; i++) {
       if ((i == 0) || (m_core_instr_cntr[i] > n_instr_max)) {
         core_id_highest_load = i;
         n_instr_max = m_core_instr_cntr[i];
@@ -72,27 +137,33 @@ Packet *ProcessingDynamicRSS::process_packet(uint8_t core_id)
       }
     }
 
-    // find redirection table entry that causes the highest load on the core
-    // that has the highest load
-    uint16_t reta_entry_highest_load;
-    bool reta_entry_found = false;
-    for (uint16_t i = 0; i < m_rss_reta_size; i++) {
-      if (m_rss_reta[i] != core_id_highest_load) {
-        continue;
-      }
+    if (m_enabled_balance_rx_queues) {
+      // move a whole rx queue from the core with the highest load to the core
+      // with the lowest load
+      balance_rx_queues(core_id_highest_load, core_id_lowest_load);
+    } else {
+      // find redirection table entry that causes the highest load on the core
+      // that has the highest load
+      uint16_t reta_entry_highest_load;
+      bool reta_entry_found = false;
+      for (uint16_t i = 0; i < m_rss_reta_size; i++) {
+        if (get_rx_queue_core(m_rss_reta[i]) != core_id_highest_load) {
+          continue;
+        }
 
-      if (!reta_entry_found || (m_rss_reta_instr_cntr[i] > n_instr_max)) {
-        reta_entry_highest_load = i;
-        reta_entry_found = true;
-        n_instr_max = m_rss_reta_instr_cntr[i];
+        if (!reta_entry_found || (m_rss_reta_instr_cntr[i] > n_instr_max)) {
+          reta_entry_highest_load = i;
+          reta_entry_found = true;
+          n_instr_max = m_rss_reta_instr_cntr[i];
+        }
       }
-    }
 
-    // update reta entry
-    if (reta_entry_found) {
-      m_rss_reta[reta_entry_highest_load] = core_id_lowest_load;
-      m_module_offload->update_rss_reta_entry(reta_entry_highest_load,
-                                              core_id_lowest_load);
+      // update reta entry. it is pointed to the least loaded rx queue of the
+      // core with the lowest load
+      int16_t rx_queue = find_rx_queue_lowest_load(core_id_lowest_load);
+      if (reta_entry_found && (rx_queue >= 0)) {
+        update_rss_reta_entry(reta_entry_highest_load, rx_queue);
+      }
     }
 
     // reset all per-core instruction counters
@@ -100,15 +171,172 @@ Packet *ProcessingDynamicRSS::process_packet(uint8_t core_id)
       m_core_instr_cntr[i] = 0;
     }
 
+    // reset all per-rx queue instruction counters
+    for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+      m_rx_queue_instr_cntr[i] = 0;
+    }
+
     // reset all reta instruction counters
     for (uint16_t i = 0; i < m_rss_reta_size; i++) {
       m_rss_reta_instr_cntr[i] = 0;
     }
-
-    // save reassignment time
-    m_t_last_reassignment = simTime();
   }
 
   // return packet
   return pkt;
 }
+
+uint8_t ProcessingDynamicRSS::calc_n_active_cores(simtime_t t_interval)
+{
+  // sum up instructions executed by all cores during the last interval
+  uint64_t n_instr = 0;
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    n_instr += m_core_instr_cntr[i];
+  }
+
+  // calculate the number of fully utilized cores this corresponds to
+  double util = n_instr * m_t_inst_base / t_interval;
+
+  // number of cores needed to keep their utilization below the target
+  uint8_t n_active_cores = (uint8_t)ceil(util / m_consolidation_target_util);
+  if (n_active_cores < 1) {
+    n_active_cores = 1;
+  } else if (n_active_cores > m_n_cores) {
+    n_active_cores = m_n_cores;
+  }
+
+  return n_active_cores;
+}
+
+void ProcessingDynamicRSS::calc_n_instr_active_cores(
+    std::vector<uint64_t> &n_instr_core)
+{
+  // instructions of the rx queues currently assigned to each active core
+  // during the last interval
+  n_instr_core.assign(m_n_active_cores, 0);
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    uint8_t core_id = get_rx_queue_core(i);
+    if (core_id < m_n_active_cores) {
+      n_instr_core[core_id] += m_rx_queue_instr_cntr[i];
+    }
+  }
+}
+
+void ProcessingDynamicRSS::consolidate_reta()
+{
+  std::vector<uint64_t> n_instr_core;
+  calc_n_instr_active_cores(n_instr_core);
+
+  // move each reta entry pointing to an rx queue of an inactive core to the
+  // active core with the currently lowest load
+  for (uint16_t i = 0; i < m_rss_reta_size; i++) {
+    if (get_rx_queue_core(m_rss_reta[i]) < m_n_active_cores) {
+      continue;
+    }
+
+    uint8_t core_id_lowest_load = 0;
+    for (uint8_t j = 1; j < m_n_active_cores; j++) {
+      if (n_instr_core[j] < n_instr_core[core_id_lowest_load]) {
+        core_id_lowest_load = j;
+      }
+    }
+
+    int16_t rx_queue = find_rx_queue_lowest_load(core_id_lowest_load);
+    if (rx_queue < 0) {
+      continue;
+    }
+
+    update_rss_reta_entry(i, rx_queue);
+    n_instr_core[core_id_lowest_load] += m_rss_reta_instr_cntr[i];
+  }
+}
+
+void ProcessingDynamicRSS::consolidate_rx_queues()
+{
+  std::vector<uint64_t> n_instr_core;
+  calc_n_instr_active_cores(n_instr_core);
+
+  // move each rx queue of an inactive core to the active core with the
+  // currently lowest load
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    if (get_rx_queue_core(i) < m_n_active_cores) {
+      continue;
+    }
+
+    uint8_t core_id_lowest_load = 0;
+    for (uint8_t j = 1; j < m_n_active_cores; j++) {
+      if (n_instr_core[j] < n_instr_core[core_id_lowest_load]) {
+        core_id_lowest_load = j;
+      }
+    }
+
+    move_rx_queue(i, core_id_lowest_load);
+    n_instr_core[core_id_lowest_load] += m_rx_queue_instr_cntr[i];
+  }
+}
+
+void ProcessingDynamicRSS::balance_rx_queues(uint8_t core_id_highest_load,
+                                             uint8_t core_id_lowest_load)
+{
+  // load imbalance between the two cores during the last interval
+  uint64_t n_instr_diff = m_core_instr_cntr[core_id_highest_load] -
+                          m_core_instr_cntr[core_id_lowest_load];
+
+  // find the rx queue on the core with the highest load whose move reduces the
+  // imbalance the most, i.e. whose load is closest to half of the imbalance.
+  // queues carrying the whole imbalance or more would only shift it
+  int16_t rx_queue_selected = -1;
+  uint64_t n_instr_dist_min;
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    uint64_t n_instr = m_rx_queue_instr_cntr[i];
+    if ((get_rx_queue_core(i) != core_id_highest_load) || (n_instr == 0) ||
+        (n_instr >= n_instr_diff)) {
+      continue;
+    }
+
+    uint64_t n_instr_dist = (2 * n_instr > n_instr_diff)
+                                ? 2 * n_instr - n_instr_diff
+                                : n_instr_diff - 2 * n_instr;
+    if ((rx_queue_selected < 0) || (n_instr_dist < n_instr_dist_min)) {
+      rx_queue_selected = i;
+      n_instr_dist_min = n_instr_dist;
+    }
+  }
+
+  // move the rx queue
+  if (rx_queue_selected >= 0) {
+    move_rx_queue(rx_queue_selected, core_id_lowest_load);
+  }
+}
+
+int16_t ProcessingDynamicRSS::find_rx_queue_lowest_load(uint8_t core_id)
+{
+  // find the rx queue with the lowest load among the ones polled by the
+  // specified core
+  int16_t rx_queue_selected = -1;
+  for (uint8_t i = 0; i < m_n_rx_queues; i++) {
+    if (get_rx_queue_core(i) != core_id) {
+      continue;
+    }
+    if ((rx_queue_selected < 0) ||
+        (m_rx_queue_instr_cntr[i] <
+         m_rx_queue_instr_cntr[rx_queue_selected])) {
+      rx_queue_selected = i;
+    }
+  }
+  return rx_queue_selected;
+}
+
+void ProcessingDynamicRSS::update_rss_reta_entry(uint16_t entry,
+                                                 uint8_t rx_queue)
+{
+  // update local copy of the reta entry and inform the offload module, which
+  // steers the packets according to the reta
+  m_rss_reta[entry] = rx_queue;
+
+  RetaUpdateMsg *msg = new RetaUpdateMsg;
+  msg->setKind(MSG_KIND_RETA_UPDATE);
+  msg->setEntry(entry);
+  msg->setRxQueue(rx_queue);
+  send(msg, "reta_out");
+}
@@ -3,27 +3,40 @@
 
 #include "Processing.h"
 
-class Offload;
-
 class ProcessingDynamicRSS : public Processing
 {
 public:
   virtual ~ProcessingDynamicRSS();
   virtual void initialize();
+  virtual void handleParameterChange(const char *name);
 
 private:
   virtual Packet *process_packet(uint8_t core_id);
+  uint8_t calc_n_active_cores(simtime_t t_interval);
+  void calc_n_instr_active_cores(std::vector<uint64_t> &n_instr_core);
+  void consolidate_reta();
+  void consolidate_rx_queues();
+  void balance_rx_queues(uint8_t core_id_highest_load,
+                         uint8_t core_id_lowest_load);
+  int16_t find_rx_queue_lowest_load(uint8_t core_id);
+  void update_rss_reta_entry(uint16_t entry, uint8_t rx_queue);
 
   uint16_t m_rss_reta_size;
   uint8_t *m_rss_reta;
 
   uint64_t *m_core_instr_cntr;
+  uint64_t *m_rx_queue_instr_cntr;
   uint64_t *m_rss_reta_instr_cntr;
 
   simtime_t m_t_last_reassignment;
   simtime_t m_t_reassignment_interval;
 
-  Offload *m_module_offload;
+  bool m_enabled_balance_rx_queues;
+  bool m_enabled_consolidation;
+  double m_consolidation_target_util;
+  uint8_t m_n_active_cores;
+
+  simsignal_t m_sig_stats_n_active_cores;
 };
 
 #endif
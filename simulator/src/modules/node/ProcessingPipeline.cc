@@ -0,0 +1,356 @@
+#include "ProcessingPipeline.h"
+#include "../../defines.h"
+#include "../../msgs/Packet.h"
+#include "../../msgs/PacketNodeContext.h"
+#include "../../msgs/ProcDoneMsg_m.h"
+#include "../../msgs/QueueLenMsg_m.h"
+#include "../Profiler.h"
+#include "FlowControl.h"
+#include "OffloadTrigger.h"
+#include "OutputBuffer.h"
+
+Define_Module(ProcessingPipeline);
+
+ProcessingPipeline::~ProcessingPipeline()
+{
+  for (uint8_t i = 0; i < m_cores.size(); i++) {
+    // if there is currently a packet being processed on the core, delete it
+    if (m_cores[i].msg_proc_done->isScheduled()) {
+      delete (Packet *)m_cores[i].msg_proc_done->getContextPointer();
+    }
+
+    // cancel possibly outstanding self-message
+    cancelAndDelete(m_cores[i].msg_proc_done);
+  }
+
+  delete[] m_sigs_stats_proc_util_stage;
+  delete[] m_sigs_stats_queue_len;
+}
+
+void ProcessingPipeline::initialize()
+{
+  // get the number of CPU cores
+  m_n_cores = par("n_cores");
+  m_n_rx_queues = par("n_rx_queues");
+
+  // get the per CPU core processing capacity (instructions/seconds) and
+  // calculate the duration of one CPU instruction
+  double capacity_per_core = par("capacity_per_core");
+  m_t_inst = 1.0 / capacity_per_core;
+
+  // record total capacity
+  recordScalar("capacity_total", m_n_cores * capacity_per_core);
+
+  // get number of instructions required to hand a packet over to the next
+  // stage
+  m_handoff_instr = par("handoff_instr");
+
+  // get the number of cores per stage and create stages
+  std::vector<int> stage_n_cores =
+      cStringTokenizer(par("stage_n_cores").stringValue()).asIntVector();
+  if (stage_n_cores.empty()) {
+    throw cRuntimeError("service chain must have at least one stage");
+  }
+  uint8_t n_cores_total = 0;
+  for (size_t i = 0; i < stage_n_cores.size(); i++) {
+    if (stage_n_cores[i] <= 0) {
+      throw cRuntimeError("each stage must be served by at least one core");
+    }
+    stage_t stage;
+    stage.first_core = n_cores_total;
+    stage.n_cores = stage_n_cores[i];
+    stage.n_cores_busy = 0;
+    m_stages.push_back(stage);
+    n_cores_total += stage_n_cores[i];
+  }
+  if (n_cores_total != m_n_cores) {
+    throw cRuntimeError("number of cores per stage must add up to n_cores");
+  }
+
+  // get per-action instruction shares of each stage
+  cStringTokenizer tokenizer_actions(par("stage_instr_shares").stringValue(),
+                                     ";");
+  while (tokenizer_actions.hasMoreTokens()) {
+    std::vector<double> shares =
+        cStringTokenizer(tokenizer_actions.nextToken()).asDoubleVector();
+    if (shares.size() != m_stages.size()) {
+      throw cRuntimeError("number of instruction shares does not match number "
+                          "of stages");
+    }
+    m_stage_instr_shares.push_back(shares);
+  }
+  if (m_stage_instr_shares.empty()) {
+    throw cRuntimeError("no stage instruction shares specified");
+  }
+
+  // register signals for stats collection (executed IPP and processor
+  // utilization)
+  m_sig_stats_ipp = registerSignal("stats_ipp");
+  m_sig_stats_proc_util = registerSignal("stats_proc_util");
+
+  // register signals for stats collection (per-stage utilization)
+  m_sigs_stats_proc_util_stage = new simsignal_t[m_stages.size()];
+  for (uint8_t i = 0; i < m_stages.size(); i++) {
+    char signal_name[32];
+    char stats_name[32];
+    sprintf(signal_name, "stats_proc_util_stage%d", i);
+    sprintf(stats_name, "proc_util_stage%d", i);
+    m_sigs_stats_proc_util_stage[i] = registerSignal(signal_name);
+    cProperty *statisticsTemplate =
+        getProperties()->get("statisticTemplate", "proc_util_stage");
+    getEnvir()->addResultRecorders(this, m_sigs_stats_proc_util_stage[i],
+                                   stats_name, statisticsTemplate);
+  }
+
+  // create cores and register signals for stats collection (per-core queue
+  // lengths)
+  m_sigs_stats_queue_len = new simsignal_t[m_n_cores];
+  m_cores.resize(m_n_cores);
+  for (uint8_t i = 0; i < m_stages.size(); i++) {
+    for (uint8_t j = 0; j < m_stages[i].n_cores; j++) {
+      core_t &core = m_cores[m_stages[i].first_core + j];
+      core.stage = i;
+      core.busy = false;
+      ProcDoneMsg *msg_proc_done = new ProcDoneMsg();
+      msg_proc_done->setKind(MSG_KIND_PROC_DONE);
+      msg_proc_done->setCoreId(m_stages[i].first_core + j);
+      core.msg_proc_done = msg_proc_done;
+    }
+  }
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    char signal_name[32];
+    char stats_name[32];
+    sprintf(signal_name, "stats_queue_len%d", i);
+    sprintf(stats_name, "queue_len%d", i);
+    m_sigs_stats_queue_len[i] = registerSignal(signal_name);
+    cProperty *statisticsTemplate =
+        getProperties()->get("statisticTemplate", "queue_len");
+    getEnvir()->addResultRecorders(this, m_sigs_stats_queue_len[i], stats_name,
+                                   statisticsTemplate);
+  }
+
+  // initially no core is busy
+  m_n_cores_busy = 0;
+
+  // queue lengths are reported to the offload trigger, which is only connected
+  // if offloading is enabled. on the fast path, they are reported by a direct
+  // call instead of a message
+  m_enabled_offload_trigger = gate("trigger_out")->isConnected();
+  m_module_offload_trigger = NULL;
+  if (m_enabled_offload_trigger && par("enable_fast_path").boolValue()) {
+    m_module_offload_trigger = (OffloadTrigger *)gate("trigger_out")
+                                   ->getPathEndGate()
+                                   ->getOwnerModule();
+  }
+
+  // get pointer on flow control module
+  m_module_flow_control = (FlowControl *)getModuleByPath("^.flow_control");
+  ASSERT(m_module_flow_control);
+
+  // on the fast path, processed packets are handed over to the output buffer
+  // by a direct call instead of a message
+  m_module_out_buffer = NULL;
+  if (par("enable_fast_path").boolValue()) {
+    m_module_out_buffer =
+        (OutputBuffer *)gate("out")->getPathEndGate()->getOwnerModule();
+  }
+}
+
+void ProcessingPipeline::handleMessage(cMessage *msg)
+{
+  PROFILE_HANDLE_MESSAGE("ProcessingPipeline");
+
+  if (msg->isSelfMessage() == false) {
+    // new packet arriving
+    ASSERT(msg->getKind() == MSG_KIND_PACKET_DATA);
+    Packet *pkt = (Packet *)msg;
+
+    // report total number of instructions executed on the packet
+    if (STATS_DETAILED) {
+      emit(m_sig_stats_ipp, pkt->get_instr());
+    }
+
+    // packet has been accepted from the link
+    m_module_flow_control->report_pkt_enqueued();
+
+    // the rx queue determines the core of the first stage the packet is
+    // processed on
+    uint8_t rx_queue = pkt->get_node_ctx()->get_rx_queue();
+    enqueue_pkt(pkt, rx_queue % m_stages[0].n_cores);
+  } else {
+    // this is a self-message signaling that a packet has been completely
+    // processed by a stage
+    ASSERT(msg->getKind() == MSG_KIND_PROC_DONE);
+    Packet *pkt = (Packet *)msg->getContextPointer();
+
+    // get the core the packet has been processed on
+    uint8_t core_id = ((ProcDoneMsg *)msg)->getCoreId();
+    ASSERT(core_id < m_n_cores);
+    core_t &core = m_cores[core_id];
+    ASSERT(core.msg_proc_done == msg);
+    ASSERT(core.busy);
+
+    if (core.stage == m_stages.size() - 1) {
+      // packet has passed the whole chain. send it out
+      pkt->set_processing_done();
+      pkt->get_node_ctx()->release_in_flight_cntr();
+      if (m_module_out_buffer) {
+        m_module_out_buffer->receive_pkt(pkt);
+      } else {
+        pkt->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+        send(pkt, "out");
+      }
+    } else {
+      // hand packet over to the next stage
+      uint8_t stage_nxt = core.stage + 1;
+      enqueue_pkt(pkt, select_core(pkt, stage_nxt));
+    }
+
+    if (core.queue.isEmpty() == false) {
+      // more packets are waiting to be processed on this core
+      process_packet(core_id);
+    } else {
+      // no more packets waiting. set core idle
+      set_busy(core_id, false);
+    }
+  }
+}
+
+void ProcessingPipeline::enqueue_pkt(Packet *pkt, uint8_t core_id)
+{
+  core_t &core = m_cores[core_id];
+
+  // remember when the packet has been enqueued to calculate the time it spent
+  // waiting
+  pkt->setTimestamp(simTime());
+
+  // insert packet into the core's queue
+  core.queue.insert(pkt);
+  if (STATS_DETAILED) {
+    emit(m_sigs_stats_queue_len[core_id], core.queue.getLength());
+  }
+
+  if (core.busy == false) {
+    // core has been idle. set it active now and start processing the packet
+    set_busy(core_id, true);
+    process_packet(core_id);
+  }
+}
+
+uint32_t ProcessingPipeline::get_total_queue_len()
+{
+  // return the number of packets that are currently waiting to be processed
+  // by any of the stages
+  uint32_t queue_len = 0;
+  for (uint8_t i = 0; i < m_n_cores; i++) {
+    queue_len += m_cores[i].queue.getLength();
+  }
+  return queue_len;
+}
+
+void ProcessingPipeline::process_packet(uint8_t core_id)
+{
+  core_t &core = m_cores[core_id];
+  ASSERT(core.busy);
+  ASSERT(core.queue.isEmpty() == false);
+
+  if (core.stage == 0) {
+    // the queues of the first stage are the ones filled by the offload module.
+    // report the queue length for all rx queues mapped onto this core
+    for (uint8_t i = core_id; i < m_n_rx_queues; i += m_stages[0].n_cores) {
+      report_queue_len(i, core.queue.getLength());
+    }
+  }
+
+  // pop packet from queue. packets leaving the first stage's queues free
+  // their slot in the node's rx queues
+  Packet *pkt = (Packet *)core.queue.pop();
+  if (core.stage == 0) {
+    m_module_flow_control->report_pkt_dequeued();
+  }
+
+  // calculate the time required to execute the stage's share of the packet's
+  // instructions. all stages but the last one also spend time on handing the
+  // packet over to the next stage
+  uint32_t instr = calc_stage_instr(pkt, core.stage);
+  if (core.stage < m_stages.size() - 1) {
+    instr += m_handoff_instr;
+  }
+  simtime_t t_proc = instr * m_t_inst;
+
+  // add latency elements for the time the packet has been waiting and the
+  // processing duration
+  Latency *latency = pkt->get_latency();
+  latency->add_element(new LatencyElement(LatencyElement::NODE_BUFFER_IN,
+                                          simTime() - pkt->getTimestamp()));
+  latency->add_element(new LatencyElement(LatencyElement::NODE_PROC, t_proc));
+
+  // schedule self-message to be sent after processing is completed. pass along
+  // a pointer to the packet as context
+  core.msg_proc_done->setContextPointer(pkt);
+  scheduleAt(simTime() + t_proc, core.msg_proc_done);
+}
+
+void ProcessingPipeline::report_queue_len(uint8_t rx_queue,
+                                          uint32_t queue_len)
+{
+  if (m_module_offload_trigger) {
+    m_module_offload_trigger->report_queue_len(rx_queue, queue_len);
+  } else if (m_enabled_offload_trigger) {
+    QueueLenMsg *msg = new QueueLenMsg;
+    msg->setKind(MSG_KIND_QUEUE_LEN);
+    msg->setQueueId(rx_queue);
+    msg->setQueueLen(queue_len);
+    msg->setSchedulingPriority(MSG_PRIORITY_NODE_HANDOVER);
+    send(msg, "trigger_out");
+  }
+}
+
+void ProcessingPipeline::set_busy(uint8_t core_id, bool busy)
+{
+  core_t &core = m_cores[core_id];
+  stage_t &stage = m_stages[core.stage];
+
+  // save core busy/idle state
+  core.busy = busy;
+
+  // maintain number of currently busy cores
+  if (busy) {
+    m_n_cores_busy++;
+    stage.n_cores_busy++;
+  } else {
+    ASSERT(m_n_cores_busy > 0 && stage.n_cores_busy > 0);
+    m_n_cores_busy--;
+    stage.n_cores_busy--;
+  }
+
+  // report utilization statistics
+  if (STATS_DETAILED) {
+    emit(m_sigs_stats_proc_util_stage[core.stage], stage.n_cores_busy);
+    emit(m_sig_stats_proc_util, m_n_cores_busy);
+  }
+}
+
+uint8_t ProcessingPipeline::select_core(Packet *pkt, uint8_t stage)
+{
+  // all packets of a flow are processed by the same core of a stage, so that
+  // the pipeline does not reorder them
+  stage_t &s = m_stages[stage];
+  return s.first_core + pkt->get_flow().get_toeplitz_hash() % s.n_cores;
+}
+
+uint32_t ProcessingPipeline::calc_stage_instr(Packet *pkt, uint8_t stage)
+{
+  // get the shares of the action executed on the flow's packets. flows without
+  // an action (ipp values read from file) use the shares of the first action
+  uint32_t action_id = 0;
+  if (pkt->get_flow().is_action_id_set()) {
+    action_id = pkt->get_flow().get_action_id();
+  }
+  if (action_id >= m_stage_instr_shares.size()) {
+    action_id = 0;
+  }
+
+  return (uint32_t)(pkt->get_instr() * m_stage_instr_shares[action_id][stage] +
+                    0.5);
+}
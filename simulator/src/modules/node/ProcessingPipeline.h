@@ -0,0 +1,72 @@
+#ifndef MODULES_NODE_PROCESSINGPIPELINE_H_
+#define MODULES_NODE_PROCESSINGPIPELINE_H_
+
+#include "IProcessing.h"
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+class FlowControl;
+class OffloadTrigger;
+class OutputBuffer;
+class Packet;
+
+// models a chain of network functions executed in pipeline mode. each stage
+// of the chain is served by its own pool of cores. after a packet has been
+// processed by a stage, it is handed over to a core of the next stage
+class ProcessingPipeline : public cSimpleModule, public IProcessing
+{
+public:
+  virtual ~ProcessingPipeline();
+
+  virtual uint32_t get_total_queue_len() override;
+
+protected:
+  virtual void initialize();
+  virtual void handleMessage(cMessage *msg);
+
+private:
+  typedef struct {
+    uint8_t first_core; // id of the first core serving the stage
+    uint8_t n_cores;    // number of cores serving the stage
+    uint8_t n_cores_busy;
+  } stage_t;
+
+  typedef struct {
+    uint8_t stage;       // stage served by this core
+    cPacketQueue queue;  // packets waiting to be processed by this core
+    bool busy;           // core busy?
+    cMessage *msg_proc_done;
+  } core_t;
+
+  void enqueue_pkt(Packet *pkt, uint8_t core_id);
+  void process_packet(uint8_t core_id);
+  void report_queue_len(uint8_t rx_queue, uint32_t queue_len);
+  void set_busy(uint8_t core_id, bool busy);
+  uint8_t select_core(Packet *pkt, uint8_t stage);
+  uint32_t calc_stage_instr(Packet *pkt, uint8_t stage);
+
+  uint8_t m_n_cores;
+  uint8_t m_n_rx_queues;
+  uint8_t m_n_cores_busy;
+  simtime_t m_t_inst;
+  uint32_t m_handoff_instr;
+
+  std::vector<stage_t> m_stages;
+  std::vector<core_t> m_cores;
+
+  // per-action and per-stage share of the instructions executed on a packet
+  std::vector<std::vector<double> > m_stage_instr_shares;
+
+  bool m_enabled_offload_trigger;
+  OffloadTrigger *m_module_offload_trigger;
+  FlowControl *m_module_flow_control;
+  OutputBuffer *m_module_out_buffer;
+
+  simsignal_t m_sig_stats_ipp;
+  simsignal_t m_sig_stats_proc_util;
+  simsignal_t *m_sigs_stats_proc_util_stage;
+  simsignal_t *m_sigs_stats_queue_len;
+};
+
+#endif
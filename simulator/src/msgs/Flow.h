@@ -5,20 +5,35 @@
 
 struct Flow {
 
-  Flow(uint64_t id)
+  Flow(uint64_t id = 0, uint16_t source_id = 0)
   {
     m_id = id;
+    m_source_id = source_id;
     m_crc32_hash = 0;
     m_crc32_hash_set = false;
     m_toeplitz_hash = 0;
     m_toeplitz_hash_set = false;
+    m_action_id = 0;
+    m_action_id_set = false;
+    m_traffic_class = 0;
   }
 
   virtual ~Flow() {}
 
-  uint64_t get_id() { return m_id; }
+  uint64_t get_id() const { return m_id; }
 
-  uint32_t get_crc32_hash()
+  // index of the generator that created the flow. flow ids are only unique
+  // per generator
+  uint16_t get_source_id() const { return m_source_id; }
+
+  // key that identifies the flow across all generators
+  uint64_t get_key() const
+  {
+    ASSERT(m_id < ((uint64_t)1 << 48));
+    return ((uint64_t)m_source_id << 48) | m_id;
+  }
+
+  uint32_t get_crc32_hash() const
   {
     ASSERT(m_crc32_hash_set);
     return m_crc32_hash;
@@ -31,7 +46,7 @@ struct Flow {
     m_crc32_hash_set = true;
   }
 
-  uint32_t get_toeplitz_hash()
+  uint32_t get_toeplitz_hash() const
   {
     ASSERT(m_toeplitz_hash_set);
     return m_toeplitz_hash;
@@ -44,12 +59,67 @@ struct Flow {
     m_toeplitz_hash_set = true;
   }
 
+  uint32_t get_action_id() const
+  {
+    ASSERT(m_action_id_set);
+    return m_action_id;
+  }
+
+  void set_action_id(uint32_t action_id)
+  {
+    ASSERT(!m_action_id_set);
+    m_action_id = action_id;
+    m_action_id_set = true;
+  }
+
+  bool is_action_id_set() const { return m_action_id_set; }
+
+  // traffic class of the flow's packets. class 0 has the highest priority
+  uint8_t get_traffic_class() const { return m_traffic_class; }
+
+  void set_traffic_class(uint8_t traffic_class)
+  {
+    m_traffic_class = traffic_class;
+  }
+
+  // flows travel with their packets, which may cross partition boundaries in
+  // a parallel simulation
+  void parsim_pack(omnetpp::cCommBuffer *buffer) const
+  {
+    buffer->pack(m_id);
+    buffer->pack(m_source_id);
+    buffer->pack(m_crc32_hash);
+    buffer->pack(m_crc32_hash_set);
+    buffer->pack(m_toeplitz_hash);
+    buffer->pack(m_toeplitz_hash_set);
+    buffer->pack(m_action_id);
+    buffer->pack(m_action_id_set);
+    buffer->pack(m_traffic_class);
+  }
+
+  void parsim_unpack(omnetpp::cCommBuffer *buffer)
+  {
+    buffer->unpack(m_id);
+    buffer->unpack(m_source_id);
+    buffer->unpack(m_crc32_hash);
+    buffer->unpack(m_crc32_hash_set);
+    buffer->unpack(m_toeplitz_hash);
+    buffer->unpack(m_toeplitz_hash_set);
+    buffer->unpack(m_action_id);
+    buffer->unpack(m_action_id_set);
+    buffer->unpack(m_traffic_class);
+  }
+
 private:
   uint64_t m_id;
+  uint16_t m_source_id;
   uint32_t m_crc32_hash;
   bool m_crc32_hash_set;
   uint32_t m_toeplitz_hash;
   bool m_toeplitz_hash_set;
+  uint32_t m_action_id;
+  bool m_action_id_set;
+  uint8_t m_traffic_class;
 };
 
 #endif
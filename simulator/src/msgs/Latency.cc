@@ -11,6 +11,11 @@ simtime_t LatencyElement::get_latency() { return m_latency; }
 
 Latency::Latency() {}
 
+Latency::Latency(const Latency &other) : std::vector<LatencyElement *>()
+{
+  operator=(other);
+}
+
 Latency::~Latency()
 {
   for (iterator it = begin(); it != end(); it++) {
@@ -19,6 +24,24 @@ Latency::~Latency()
   clear();
 }
 
+Latency &Latency::operator=(const Latency &other)
+{
+  if (&other == this) {
+    return *this;
+  }
+
+  // elements are owned, so copy them instead of sharing the pointers
+  for (iterator it = begin(); it != end(); it++) {
+    delete *it;
+  }
+  clear();
+  for (const_iterator it = other.begin(); it != other.end(); it++) {
+    push_back(new LatencyElement(**it));
+  }
+  m_t_generation = other.m_t_generation;
+  return *this;
+}
+
 simtime_t Latency::get_end_to_end_latency()
 {
   return simTime() - m_t_generation;
@@ -51,3 +74,5 @@ void Latency::set_t_generation(simtime_t t_generation)
 {
   m_t_generation = t_generation;
 }
+
+simtime_t Latency::get_t_generation() const { return m_t_generation; }
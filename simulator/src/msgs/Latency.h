@@ -12,7 +12,8 @@ public:
     NODE_BUFFER_IN,
     NODE_BUFFER_OUT,
     NODE_PROC,
-    TOR
+    TOR,
+    RESEQ
   } latency_type_t;
 
   LatencyElement(latency_type_t type, simtime_t latency);
@@ -29,14 +30,18 @@ class Latency : public std::vector<LatencyElement *>
 {
 public:
   Latency();
+  Latency(const Latency &other);
   virtual ~Latency();
 
+  Latency &operator=(const Latency &other);
+
   void add_element(LatencyElement *element);
   simtime_t get_end_to_end_latency();
   simtime_t get_total_latency();
   simtime_t get_total_latency_by_type(LatencyElement::latency_type_t type);
 
   void set_t_generation(simtime_t t_generation);
+  simtime_t get_t_generation() const;
 
 private:
   simtime_t m_t_generation;
@@ -1,19 +1,37 @@
 #include "Packet.h"
+#include "../defines.h"
+#include "../modules/Profiler.h"
+#include "InFlightReleaseMsg_m.h"
 #include "PacketNodeContext.h"
 
 Packet::Packet(const char *name) : Packet_Base(name)
 {
   m_id = -1;
-  m_flow = NULL;
+  m_flow_set = false;
   m_hop_cnt = 0;
   m_node_ctx = new PacketNodeContext;
   m_instr = 0;
   m_processing_done = false;
+  m_load_stamp_node_id = -1;
+  m_load_stamp = 0;
+  m_offload_target = -1;
+  m_visited_nodes = 0;
+  m_traffic_class = 0;
+  Profiler::report_pkt_alloc();
 }
 
-Packet::Packet(const Packet &other) : Packet_Base(other) { operator=(other); }
+Packet::Packet(const Packet &other) : Packet_Base(other)
+{
+  m_node_ctx = new PacketNodeContext;
+  Profiler::report_pkt_alloc();
+  operator=(other);
+}
 
-Packet::~Packet() { delete m_node_ctx; }
+Packet::~Packet()
+{
+  delete m_node_ctx;
+  Profiler::report_pkt_free();
+}
 
 Packet &Packet::operator=(const Packet &other)
 {
@@ -23,15 +41,102 @@ Packet &Packet::operator=(const Packet &other)
   Packet_Base::operator=(other);
   m_id = other.m_id;
   m_flow = other.m_flow;
+  m_flow_set = other.m_flow_set;
+  m_latency = other.m_latency;
   m_hop_cnt = other.m_hop_cnt;
-  m_node_ctx = other.m_node_ctx;
+  // the context is owned by each packet, so copy its contents
+  *m_node_ctx = *other.m_node_ctx;
   m_instr = other.m_instr;
   m_processing_done = other.m_processing_done;
+  m_in_flight_refs = other.m_in_flight_refs;
+  m_load_stamp_node_id = other.m_load_stamp_node_id;
+  m_load_stamp = other.m_load_stamp;
+  m_offload_target = other.m_offload_target;
+  m_visited_nodes = other.m_visited_nodes;
+  m_traffic_class = other.m_traffic_class;
   return *this;
 }
 
 Packet *Packet::dup() const { return new Packet(*this); }
 
+void Packet::parsimPack(cCommBuffer *buffer) const
+{
+  Packet_Base::parsimPack(buffer);
+
+  // packets only cross partition boundaries on links between modules, which
+  // is after their node context has been cleared
+  ASSERT(m_node_ctx->is_clear());
+
+  buffer->pack(m_id);
+  buffer->pack(m_flow_set);
+  m_flow.parsim_pack(buffer);
+
+  buffer->pack((uint32_t)m_latency.size());
+  for (size_t i = 0; i < m_latency.size(); i++) {
+    buffer->pack((int32_t)m_latency[i]->get_type());
+    buffer->pack(m_latency[i]->get_latency());
+  }
+  buffer->pack(m_latency.get_t_generation());
+
+  buffer->pack(m_hop_cnt);
+  buffer->pack(m_instr);
+  buffer->pack(m_traffic_class);
+  buffer->pack(m_processing_done);
+
+  buffer->pack((uint32_t)m_in_flight_refs.size());
+  for (size_t i = 0; i < m_in_flight_refs.size(); i++) {
+    buffer->pack(m_in_flight_refs[i].node_id);
+    buffer->pack(m_in_flight_refs[i].entry_id);
+  }
+
+  buffer->pack(m_load_stamp_node_id);
+  buffer->pack(m_load_stamp);
+  buffer->pack(m_offload_target);
+  buffer->pack(m_visited_nodes);
+}
+
+void Packet::parsimUnpack(cCommBuffer *buffer)
+{
+  Packet_Base::parsimUnpack(buffer);
+
+  buffer->unpack(m_id);
+  buffer->unpack(m_flow_set);
+  m_flow.parsim_unpack(buffer);
+
+  uint32_t n_latency_elements;
+  buffer->unpack(n_latency_elements);
+  ASSERT(m_latency.size() == 0);
+  for (uint32_t i = 0; i < n_latency_elements; i++) {
+    int32_t type;
+    simtime_t latency;
+    buffer->unpack(type);
+    buffer->unpack(latency);
+    m_latency.add_element(new LatencyElement(
+        (LatencyElement::latency_type_t)type, latency));
+  }
+  simtime_t t_generation;
+  buffer->unpack(t_generation);
+  m_latency.set_t_generation(t_generation);
+
+  buffer->unpack(m_hop_cnt);
+  buffer->unpack(m_instr);
+  buffer->unpack(m_traffic_class);
+  buffer->unpack(m_processing_done);
+
+  uint32_t n_in_flight_refs;
+  buffer->unpack(n_in_flight_refs);
+  m_in_flight_refs.resize(n_in_flight_refs);
+  for (uint32_t i = 0; i < n_in_flight_refs; i++) {
+    buffer->unpack(m_in_flight_refs[i].node_id);
+    buffer->unpack(m_in_flight_refs[i].entry_id);
+  }
+
+  buffer->unpack(m_load_stamp_node_id);
+  buffer->unpack(m_load_stamp);
+  buffer->unpack(m_offload_target);
+  buffer->unpack(m_visited_nodes);
+}
+
 void Packet::set_id(uint64_t id)
 {
   ASSERT(m_id == -1);
@@ -44,15 +149,16 @@ uint64_t Packet::get_id()
   return (uint64_t)m_id;
 }
 
-void Packet::set_flow(Flow *flow)
+void Packet::set_flow(const Flow &flow)
 {
-  ASSERT(m_flow == NULL);
+  ASSERT(!m_flow_set);
   m_flow = flow;
+  m_flow_set = true;
 }
 
-Flow *Packet::get_flow()
+const Flow &Packet::get_flow()
 {
-  ASSERT(m_flow);
+  ASSERT(m_flow_set);
   return m_flow;
 }
 
@@ -70,6 +176,13 @@ void Packet::set_instr(uint32_t instr) { m_instr = instr; }
 
 uint32_t Packet::get_instr() { return m_instr; }
 
+void Packet::set_traffic_class(uint8_t traffic_class)
+{
+  m_traffic_class = traffic_class;
+}
+
+uint8_t Packet::get_traffic_class() { return m_traffic_class; }
+
 void Packet::set_processing_done()
 {
   ASSERT(!m_processing_done);
@@ -77,3 +190,79 @@ void Packet::set_processing_done()
 }
 
 bool Packet::is_processing_done() { return m_processing_done; }
+
+void Packet::add_in_flight_ref(uint8_t node_id, uint32_t entry_id)
+{
+  // the referenced counter is released once the packet arrives at the sink
+  in_flight_ref_t ref;
+  ref.node_id = node_id;
+  ref.entry_id = entry_id;
+  m_in_flight_refs.push_back(ref);
+}
+
+bool Packet::has_in_flight_refs() { return !m_in_flight_refs.empty(); }
+
+InFlightReleaseMsg *Packet::create_in_flight_release()
+{
+  // hand the references over to a message that carries them back to the
+  // nodes owning the counters
+  InFlightReleaseMsg *msg = new InFlightReleaseMsg;
+  msg->setKind(MSG_KIND_IN_FLIGHT_RELEASE);
+  msg->setNodeIdsArraySize(m_in_flight_refs.size());
+  msg->setEntryIdsArraySize(m_in_flight_refs.size());
+  for (size_t i = 0; i < m_in_flight_refs.size(); i++) {
+    msg->setNodeIds(i, m_in_flight_refs[i].node_id);
+    msg->setEntryIds(i, m_in_flight_refs[i].entry_id);
+  }
+  m_in_flight_refs.clear();
+  return msg;
+}
+
+void Packet::set_load_stamp(uint8_t node_id, uint32_t load)
+{
+  // overwrites the stamp of the previously traversed node
+  m_load_stamp_node_id = (int16_t)node_id;
+  m_load_stamp = load;
+}
+
+bool Packet::has_load_stamp() { return m_load_stamp_node_id != -1; }
+
+uint8_t Packet::get_load_stamp_node_id()
+{
+  ASSERT(m_load_stamp_node_id != -1);
+  return (uint8_t)m_load_stamp_node_id;
+}
+
+uint32_t Packet::get_load_stamp()
+{
+  ASSERT(m_load_stamp_node_id != -1);
+  return m_load_stamp;
+}
+
+void Packet::set_offload_target(uint8_t node_id)
+{
+  ASSERT(m_offload_target == -1);
+  m_offload_target = (int16_t)node_id;
+}
+
+bool Packet::has_offload_target() { return m_offload_target != -1; }
+
+uint8_t Packet::get_offload_target()
+{
+  ASSERT(m_offload_target != -1);
+  return (uint8_t)m_offload_target;
+}
+
+void Packet::clear_offload_target() { m_offload_target = -1; }
+
+void Packet::mark_visited(uint8_t node_id)
+{
+  ASSERT(node_id < 32);
+  m_visited_nodes |= (1 << node_id);
+}
+
+bool Packet::is_visited(uint8_t node_id)
+{
+  ASSERT(node_id < 32);
+  return (m_visited_nodes & (1 << node_id)) != 0;
+}
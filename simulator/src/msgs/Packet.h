@@ -5,6 +5,7 @@
 #include "Latency.h"
 #include "Packet_m.h"
 
+class InFlightReleaseMsg;
 class PacketNodeContext;
 
 class Packet : public Packet_Base
@@ -17,11 +18,14 @@ public:
   Packet &operator=(const Packet &other);
   virtual Packet *dup() const;
 
+  virtual void parsimPack(cCommBuffer *buffer) const;
+  virtual void parsimUnpack(cCommBuffer *buffer);
+
   void set_id(uint64_t id);
   uint64_t get_id();
 
-  void set_flow(Flow *flow);
-  Flow *get_flow();
+  void set_flow(const Flow &flow);
+  const Flow &get_flow();
   Latency *get_latency();
 
   void set_hop_cnt(uint8_t hop_cnt);
@@ -33,17 +37,52 @@ public:
   void set_instr(uint32_t instr);
   uint32_t get_instr();
 
+  void set_traffic_class(uint8_t traffic_class);
+  uint8_t get_traffic_class();
+
   void set_processing_done();
   bool is_processing_done();
 
+  void add_in_flight_ref(uint8_t node_id, uint32_t entry_id);
+  bool has_in_flight_refs();
+  InFlightReleaseMsg *create_in_flight_release();
+
+  void set_load_stamp(uint8_t node_id, uint32_t load);
+  bool has_load_stamp();
+  uint8_t get_load_stamp_node_id();
+  uint32_t get_load_stamp();
+
+  void set_offload_target(uint8_t node_id);
+  bool has_offload_target();
+  uint8_t get_offload_target();
+  void clear_offload_target();
+
+  void mark_visited(uint8_t node_id);
+  bool is_visited(uint8_t node_id);
+
 private:
+  // references a hashtable entry of a node's offload module, whose in-flight
+  // counter the packet holds until it arrives at the sink. packets may cross
+  // partition boundaries, so the counter is referenced by value
+  typedef struct {
+    uint8_t node_id;
+    uint32_t entry_id;
+  } in_flight_ref_t;
+
   int64_t m_id;
-  Flow *m_flow;
+  Flow m_flow;
+  bool m_flow_set;
   Latency m_latency;
   uint8_t m_hop_cnt;
   PacketNodeContext *m_node_ctx;
   uint32_t m_instr;
+  uint8_t m_traffic_class;
   bool m_processing_done;
+  std::vector<in_flight_ref_t> m_in_flight_refs;
+  int16_t m_load_stamp_node_id;
+  uint32_t m_load_stamp;
+  int16_t m_offload_target;
+  uint32_t m_visited_nodes;
 };
 
 Register_Class(Packet);
@@ -32,15 +32,59 @@ public:
     m_arrival_port_id = (int8_t)arrival_port_id;
   }
 
+  void set_in_flight_cntr(uint32_t *cntr)
+  {
+    // a packet is processed locally on exactly one node
+    ASSERT(m_in_flight_cntr == NULL);
+
+    // count packet as being in flight until its processing is done
+    m_in_flight_cntr = cntr;
+    (*m_in_flight_cntr)++;
+  }
+
+  void release_in_flight_cntr()
+  {
+    if (m_in_flight_cntr) {
+      ASSERT(*m_in_flight_cntr > 0);
+      (*m_in_flight_cntr)--;
+      m_in_flight_cntr = NULL;
+    }
+  }
+
+  uint32_t *detach_in_flight_cntr()
+  {
+    // hand the counter over to the caller, which releases it once processing
+    // is done
+    uint32_t *cntr = m_in_flight_cntr;
+    m_in_flight_cntr = NULL;
+    return cntr;
+  }
+
+  bool has_in_flight_cntr() { return m_in_flight_cntr != NULL; }
+
+  // the context is only valid while the packet is on a node. it is cleared
+  // before the packet leaves, so the in-flight counter must be released by
+  // then
+  bool is_clear()
+  {
+    return (m_rx_queue == -1) && (m_arrival_port_id == -1) &&
+           (m_in_flight_cntr == NULL);
+  }
+
   void clear()
   {
     m_rx_queue = -1;
     m_arrival_port_id = -1;
+    m_in_flight_cntr = NULL;
   }
 
 private:
   int16_t m_rx_queue;
   int8_t m_arrival_port_id;
+
+  // in-flight counter of the node's offload hashtable entry the packet is
+  // processed locally through
+  uint32_t *m_in_flight_cntr;
 };
 
 #endif